@@ -3,6 +3,14 @@
 #include <cerrno>
 #include <cstring>
 #include <map>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <iterator>
 #include <iomanip>
 #include <pwd.h>
 #include <limits.h>
@@ -10,12 +18,226 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <poll.h>
 #include "Input.h"
+#include "Frecency.h"
+#include "Snapshot.h"
+#include "Arena.h"
+#include "SharedCache.h"
+#include "Journal.h"
+#include "Prompt.h"
+#include "Profiler.h"
+#include "Readahead.h"
+#include "Lookahead.h"
+#include "Digest.h"
+#include "CommandIndex.h"
+#include "Spool.h"
+#include "Timestamp.h"
+#include "Sampler.h"
+#include "Watchdog.h"
+#include "TermWriter.h"
 
 using namespace std;
 
 // PROTOTYPES
 
+/**
+ * Reads one complete command from the given stream. If the command ends with a pipe or
+ * has an unterminated double-quote, more lines are read and appended until it doesn't.
+ *
+ * @param istream& the stream from which to read (cin, a script, or the rc file)
+ * @param string& set to the trimmed command. Empty if the line was blank
+ * @param bool true if the "> " continuation prompt should be printed
+ * @param unsigned int* if not nullptr, incremented for every line read
+ * @return false upon EOF, true otherwise
+ */
+bool read_command(istream &, string &, bool, unsigned int * = nullptr);
+
+/**
+ * Parses the given command and runs it, either as a built-in or by launching it as a job.
+ * Foreground jobs are waited on before returning.
+ *
+ * @param string the complete command to run
+ * @param const vector<string>* the lexed tokens of the command, if it has already been lexed
+ * (and validated), or nullptr
+ */
+void run_line(string, const vector<string> * = nullptr);
+
+/**
+ * Forks the shell, adding the time spent in fork() to the profile when profiling. When cout
+ * goes through term_writer, gives the child back the plain cout, since the writer thread
+ * isn't forked.
+ *
+ * @return the return value of fork()
+ */
+pid_t timed_fork();
+
+/**
+ * When cout goes through term_writer, waits (briefly) for what it has queued to reach the
+ * terminal, so that the output of the job about to be launched comes after it. Called once
+ * per job, before its first fork.
+ */
+void drain_terminal();
+
+/**
+ * Gives a forked copy of the shell caches of its own. The parent's live in the cache arena
+ * (and the frecency index is mapped DONTFORK), which the child doesn't inherit, so a child
+ * that goes on to run shell code (e.g., a command substitution that runs 'cd') would fault
+ * on them. Children that only exec() never call this, so it costs their fork nothing.
+ */
+void adopt_caches();
+
+/**
+ * Runs every command in the given script file non-interactively. With a journal, each
+ * top-level command that completes successfully in the foreground is journaled, and, when
+ * resuming, the journaled commands at the start of the script are skipped. Commands that
+ * only change shell state (e.g., cd, export) are rerun instead, so the commands after them
+ * run in the same state as before.
+ *
+ * @param const string& the path of the script
+ * @return the exit status of the last command run, or 127 if the script can't be opened
+ */
+int run_script(const string &);
+
+/**
+ * Runs the commands queued in the given spool directory (see enqueue_builtin()), up to the
+ * given number at a time, until nothing is left to claim. Each command is run by a forked
+ * copy of the shell, as if it were a line of a script, and its exit status is logged in the
+ * spool. Records left claimed by a drainer that died are queued again first.
+ *
+ * @param const string& the path of the spool directory
+ * @param unsigned int the number of commands to run at once
+ * @return EXIT_SUCCESS if every command succeeded, EXIT_FAILURE otherwise
+ */
+int drain_spool(const string &, unsigned int);
+
+/**
+ * Restores the shell state left behind by the given rc file. If its snapshot (PATH.snap)
+ * was taken from an rc file with the same hash by the same shell version, the snapshot is
+ * mapped and applied instead of running the rc file. Otherwise, the rc file is run and, if
+ * it only changed shell state (see isSnapshotSafe()), a new snapshot is written. The snapshot
+ * holds every variable the rc file exported, even one it set to the value it already had,
+ * since a later shell may inherit another value.
+ *
+ * @param const string& the path of the rc file
+ */
+void load_rc(const string &);
+
+/**
+ * Determines whether or not the given built-in only changes state that an rc snapshot can
+ * restore. If an rc file runs anything else, it is not snapshotted.
+ *
+ * @param const string& the built-in command
+ * @return true if the command's effects can be snapshotted, false if not
+ */
+bool isSnapshotSafe(const string &);
+
+/**
+ * Determines if the given command is a built-in that changes the shell's own state (its
+ * directory, environment, aliases or options), and so must be rerun when resuming a script.
+ * 'z' is instead taken back to the directory it went to, which the journal records.
+ *
+ * @param const string& the command
+ * @return true if it changes shell state, false if not
+ */
+bool isStateBuiltin(const string &);
+
+/**
+ * Determines if the given built-in only writes to stdout, without reading stdin or changing
+ * any shell state, so that a command substitution can run it in the shell itself instead of
+ * in a child.
+ *
+ * @param const string& the built-in command
+ * @return true if it can run in the shell for a substitution, false if not
+ */
+bool isSubstitutionSafe(const string &);
+
+/**
+ * Replaces every command substitution $(COMMAND) in the given input with a marker that lexes
+ * as part of a single word, so the input can be checked and lexed without the output of the
+ * substitutions. Substitutions may be nested (the inner ones are left to COMMAND), and '\$('
+ * is left as is.
+ *
+ * @param string& the input to mark in place
+ * @param vector<string>& the COMMANDs, in order
+ * @return -1 if a substitution is unterminated, 0 otherwise
+ */
+int mark_substitutions(string &, vector<string> &);
+
+/**
+ * Runs the command substitutions of input marked by mark_substitutions(), then lexes it and
+ * swaps each marker for the output of its COMMAND, less any trailing newlines. Output is
+ * split into words on whitespace, unless it is inside double-quotes, and these words are
+ * marked LITERAL, so they are never operators, redirects or aliases, whatever they contain.
+ *
+ * @param const string& the marked input
+ * @param const vector<string>& the COMMANDs
+ * @param vector<string>& the tokens, not yet alias-expanded
+ * @return -1 if a COMMAND was killed by a signal, 0 otherwise
+ */
+int expand_substitutions(const string &, const vector<string> &, vector<string> &);
+
+/**
+ * Runs the given command for a command substitution and captures its stdout. A lone built-in
+ * that isSubstitutionSafe() and has no redirects runs in the shell, with cout captured in
+ * memory. Anything else, including a command with substitutions of its own, runs in a forked
+ * copy of the shell, with stdout read from a pipe. If that copy is killed by a signal, says
+ * so and sets last_exit_status, rather than passing off what it wrote as the output.
+ *
+ * @param const string& the command
+ * @param string& the output of the command
+ * @return -1 if the command was killed by a signal, 0 otherwise
+ */
+int command_output(const string &, string &);
+
+/**
+ * Removes stages that don't change the bytes flowing through a pipeline, so that they cost
+ * neither a process nor a copy of every byte through a pipe. Rewrites 'cat FILE | CMD' as
+ * 'CMD < FILE', and drops 'cat' and 'tee [/dev/null]' stages that only copy stdin to stdout.
+ * A last stage is only dropped if the stage before it would see the same kind of stdout
+ * (i.e., not a terminal) and stderr. Must be called before the job's pipes are made.
+ *
+ * @param Input* the pipelined job to rewrite
+ * @return a description of each rewrite that was made
+ */
+vector<string> optimize_pipeline(Input*);
+
+/**
+ * Determines whether or not the given pipeline stage only copies its stdin to its stdout.
+ *
+ * @param const vector<string>& the args of the stage
+ * @return true if the stage is 'cat', 'tee', or 'tee /dev/null', false if not
+ */
+bool isIdentityStage(const vector<string> &);
+
+/**
+ * Describes the given job's pipeline and redirects as a command line.
+ *
+ * @param Input* the job to describe
+ * @return the command line
+ */
+string describe_job(Input*);
+
+/**
+ * Joins the given tokens back into a command line, double-quoting any that contain spaces or
+ * are marked LITERAL.
+ *
+ * @param const vector<string>& the tokens to join
+ * @return the joined command line
+ */
+string join_tokens(const vector<string> &);
+
+/**
+ * Flushes any pending shell state to disk, frees all jobs, and exits the shell.
+ *
+ * @param int the status with which to exit
+ */
+void exit_shell(int);
+
 /** 
  * Prints out the latest errno error and exits the process with EXIT_FAILURE.
  *
@@ -24,9 +246,50 @@ using namespace std;
 inline void nope_out(const string &);
 
 /**
- * Displays the shell prompt to the user. 
+ * Marks the start of a phase in which the REPL is busy, for the stall watchdog (if the
+ * shell is interactive).
+ *
+ * @param const char* the name of the phase, e.g. "prompt"
+ * @param const char* more about the phase (e.g., the builtin running), or nullptr
+ */
+void watch_busy(const char *, const char * = nullptr);
+
+/**
+ * Marks the start of a phase in which the REPL is waiting for input or for a foreground
+ * job, for the stall watchdog (if the shell is interactive).
+ *
+ * @param const char* the name of the phase, e.g. "input"
+ */
+void watch_idle(const char *);
+
+/**
+ * Renders the shell prompt. The prompt is rendered from the $PROMPT template (default
+ * "1730sh:{cwd}$ "), in which {cwd}, {user} and {host} are replaced right away, and {git},
+ * {kube} and {load} are segments computed asynchronously by prompt_segments. Never blocks
+ * on a segment: its last known value is shown instead.
+ *
+ * @param string& set to the rendered prompt
+ * @return true if a segment is still being computed (so the prompt may be redrawn), false if not
+ */
+bool prompt(string &);
+
+/**
+ * Replaces the prompt shown at the start of the current line with another, in place. The
+ * rest of the line may hold input the user has typed (which the terminal only hands over
+ * as a whole line), so it is shifted over rather than erased, and the cursor keeps its
+ * place in it.
+ *
+ * @param const string& the prompt that is shown
+ * @param const string& the prompt to show instead
+ */
+void redraw_prompt(const string &, const string &);
+
+/**
+ * Gets a copy of the environment, as NAME=VALUE strings.
+ *
+ * @return the environment
  */
-void prompt();
+vector<string> environ_list();
 
 /**
  * Determines if shell input is valid or not.
@@ -66,17 +329,58 @@ vector<char *> mk_cstrvec(vector<string> &);
  */
 void dl_cstrvec(vector<char *> &);
 
+/**
+ * Resolves a command name to the path of the executable that $PATH selects for it. Names
+ * containing a '/' are returned as is. Not cached: validating a cached path takes a stat()
+ * of each $PATH dir before its own, which costs as much as searching them.
+ *
+ * @param const string& the command name
+ * @return the path of the executable, or "" if none was found
+ */
+string resolve_command(const string &);
+
+/**
+ * Has the given executables (and, with 'set -o readahead-libs', their shared libraries)
+ * read into the page cache, so a later exec() doesn't wait on cold storage. The work is
+ * done on readahead_exec()'s helper thread, so this never waits on it. Empty paths (of
+ * commands that couldn't be resolved) are skipped. Does nothing unless 'set -o readahead'
+ * is on.
+ *
+ * @param const vector<string>& the paths of the executables, from resolve_command()
+ */
+void readahead_commands(const vector<string> &);
+
+/**
+ * Gets the names of the commands in a lexed line (the first word of each pipeline stage,
+ * after alias expansion), without running or fully parsing it.
+ *
+ * @param vector<string> the lexed tokens of the line
+ * @return the command names
+ */
+vector<string> command_names(vector<string>);
+
 /**
  * @source Mike's pipe2.cpp
  *
- * Attempts to execvp() the given Process using its arg vector<string>. 
- * Exits with failure if execvp() fails. 
+ * Attempts to exec the given Process using its arg vector<string>, at the path the parent
+ * already resolved, falling back to execvp(). Exits with failure if both fail. 
  *
  * @param vector<string> the given Process's arg vector<string>
  * @param int** the dynamically allocated pipes which must be deleted if exec fails
  * @param int the length of the pipes array
+ * @param const string& the path resolve_command() gave for the command, or ""
+ */
+void nice_exec(vector<string>, int**, int, const string &);
+
+/**
+ * Finds the builtins and $PATH executables whose names are closest to the given one, for
+ * suggesting what a command that wasn't found was meant to be. Looks them up in
+ * command_index, which is built on first use and then only rescans $PATH dirs that changed.
+ *
+ * @param const string& the command that wasn't found
+ * @return up to 3 names, closest first
  */
-void nice_exec(vector<string>, int**, int);
+vector<string> suggest_commands(const string &);
 
 /**
  * Returns a dynamically-allocated, multidimensional array of pipefd[2],
@@ -107,6 +411,25 @@ void deletePipes(int**, int);
  */
 void close_pipe(int[2], bool);
 
+/**
+ * Redirects the shell's own stdin, stdout and stderr to the given fds, for a built-in that
+ * runs in the shell. The fds being replaced are saved, so restore_redirects() can put them
+ * back. Negative fds and the standard fds themselves are left alone.
+ *
+ * @param int the fd for stdin
+ * @param int the fd for stdout
+ * @param int the fd for stderr
+ * @param int[3] set to the saved copies of the standard fds, or -1 for those not replaced
+ */
+void do_shell_redirects(int, int, int, int[3]);
+
+/**
+ * Puts back the standard fds saved by do_shell_redirects().
+ *
+ * @param int[3] the saved copies of the standard fds
+ */
+void restore_redirects(int[3]);
+
 /**
  * Sets the file descriptor destinations of any i/o redirection.
  *
@@ -118,6 +441,42 @@ void close_pipe(int[2], bool);
  */
 int set_redirects(Input* job, int& fdSTDIN, int& fdSTDOUT, int& fdSTDERR);
 
+/**
+ * Creates the filter for the modifier of a relay redirect: a Digest for a checksum modifier
+ * ('>#ALG[=VAR]') or a Timestamp for a timestamp modifier ('>@CLOCK'). Called before the
+ * file is opened, so an unknown modifier leaves the file alone.
+ *
+ * @param const string& the redirect operator, with its modifier
+ * @return the filter, or nullptr (after saying why) if the algorithm or clock is unknown
+ */
+RelayFilter * make_relay_filter(const string &);
+
+/**
+ * Puts a relay between a job and the file it redirects output to, for a redirect with a
+ * checksum or timestamp modifier. The relay runs on its own thread and passes every byte
+ * through the filter from make_relay_filter() on its way to the file. A digest is stored
+ * by finish_output_relays() once the job is done.
+ *
+ * @param Input* the job
+ * @param const string& the redirect operator, with its modifier
+ * @param const string& the file redirected to
+ * @param RelayFilter* the filter, which the relay takes over (or deletes, upon failure)
+ * @param int& the fd of the opened file, replaced by the write end of the relay's pipe
+ * @return -1 upon system call failure, 0 otherwise
+ */
+int open_relay_redirect(Input *, const string &, const string &, RelayFilter *, int &);
+
+/**
+ * Waits for the output relays of the given job to drain, and stores each digest in its
+ * variable or, if it has none, in the sidecar file FILE.ALG (in the format of sha256sum and
+ * the like). Called once the job (or built-in) is done writing. A relay still open after
+ * RELAY_WAIT_MS (e.g., a process the job left in the background holds the pipe) is detached
+ * from the job and finished later, by a call with nullptr from check_current_jobs().
+ *
+ * @param Input* the job, or nullptr for the detached relays that have since drained
+ */
+void finish_output_relays(Input *);
+
 /**
  * Do the dup2 i/o redirects for the given file descriptors. If any of the provided
  * values are negative, the dup2 for that redirect will not be performed.
@@ -185,11 +544,58 @@ void put_job_in_background(Input*, bool);
 
 /**
  * Checks for status changes on any currently running jobs, which are contained in the 
- * global vector<Input> current_jobs. Each time one is detected, a call to format_job_info() 
- * is made to print the status info to the user. 
+ * global vector<Input> current_jobs. The status changes detected in one pass are printed
+ * together by print_notifications().
  */
 void check_current_jobs();
 
+/**
+ * Prints the notifications collected by one pass of check_current_jobs() in one piece,
+ * through cout, so that on a terminal they queue behind earlier output in term_writer and
+ * never block reaping on a terminal that isn't reading. If more than $NOTIFY_LIMIT (default
+ * 10) jobs exited, they are summarized in one line instead, and the full list is kept for
+ * 'jobs -x'.
+ *
+ * @param string& the notifications that are always printed (e.g., stopped jobs)
+ * @param const vector<string>& the notification for each job that exited
+ * @param size_t how many of the jobs that exited failed
+ */
+void print_notifications(string &, const vector<string> &, size_t);
+
+/**
+ * Formats a count with thousands separators (e.g., 4,812).
+ *
+ * @param size_t the count
+ * @return the formatted count
+ */
+string with_commas(size_t);
+
+/**
+ * Walks /proc down from the shell to the descendants of current jobs and records which job
+ * each descends from: by process group if it still shares the job's, otherwise by its chain
+ * of parents. Descendants that have been reparented to the shell are marked as orphaned.
+ * Where the kernel doesn't list children, all of /proc is scanned instead, at most once per
+ * TRACK_SCAN_MS. Only called while the shell is a subreaper.
+ *
+ * @param Input* a foreground job that just finished, to which orphans that left its session
+ *        (e.g., with setsid) are attributed if no other job could have started them, or nullptr
+ */
+void track_descendants(Input * = nullptr);
+
+/**
+ * Reaps, without blocking, every orphaned descendant that has exited, keeping its exit
+ * status and resource usage for 'jobs -a'.
+ */
+void reap_orphans();
+
+/**
+ * Applies the side effects of the shell option with the given name, after it is toggled.
+ *
+ * @param const string& the name of the option
+ * @return -1 upon system call failure, 0 otherwise
+ */
+int apply_option(const string &);
+
 /**
  * Searches the current_jobs vector<Input*> for a job with the same JID as the given
  * input. If it finds one, it deletes it from memory and replaces its value in the 
@@ -211,6 +617,54 @@ void handler_SIGCHLD(int);
  */
 void chdir_home();
 
+/**
+ * Gets the full path of the given file in the user's home dir.
+ *
+ * @param const string& the name of the file, relative to the home dir
+ * @return the full path of the file
+ */
+string home_path(const string &);
+
+/**
+ * Resolves the '.' and '..' components of the given absolute path lexically, without
+ * consulting the file system (i.e., "/a/b/../c" becomes "/a/c" even if b is a symlink).
+ *
+ * @param const string& the absolute path to be resolved
+ * @return the resolved path, always beginning with '/' and never ending with '/' (unless root)
+ */
+string lexical_path(const string &);
+
+/**
+ * Abbreviates the user's home dir at the start of the given path with '~'.
+ *
+ * @param const string& the absolute path to be abbreviated
+ * @return the abbreviated path
+ */
+string tilde_path(const string &);
+
+/**
+ * Determines whether or not the given path is a directory. Results are cached so that
+ * repeated CDPATH searches do not stat() the same candidates again. Negative results
+ * expire after CDPATH_NEG_TTL seconds; positive results live until a chdir() to them fails.
+ *
+ * @param const string& the absolute path to check
+ * @return true if the path is (or recently was) a directory, false if not
+ */
+bool is_dir_cached(const string &);
+
+/**
+ * Changes the current working directory to the given destination, keeping track of the
+ * logical working directory in $PWD and the previous one in $OLDPWD. Relative destinations
+ * are searched for in $CDPATH (if set) and then resolved against the logical working dir.
+ * On the hot path, the only system call made is a single chdir().
+ *
+ * @param const string& the destination directory (already '~' expanded)
+ * @param bool true if the new working directory should be printed on success
+ * @param const string& the name of the calling built-in, used for error messages
+ * @return -1 if the chdir failed, 0 otherwise
+ */
+int change_dir(const string &, bool, const string &);
+
 /**
  * Prints ASCII art shell logo.
  */
@@ -259,6 +713,78 @@ int help_builtin(const vector<string>&);
  */
 int cd_builtin(const vector<string>&);
 
+/**
+ * Prints the logical current working directory ($PWD). With -P, prints the physical
+ * directory instead, with all symlinks resolved.
+ *
+ * @param const vector<string>& the args with which to call 'pwd'
+ * @return -1 if invalid syntax or system call failure, 0 otherwise
+ */
+int pwd_builtin(const vector<string>&);
+
+/**
+ * Pushes the current working directory onto the directory stack and changes to the
+ * specified one. With no args, swaps the current directory with the top of the stack.
+ *
+ * @param const vector<string>& the args with which to call 'pushd'
+ * @return -1 if invalid syntax or system call failure, 0 otherwise
+ */
+int pushd_builtin(const vector<string>&);
+
+/**
+ * Pops the top of the directory stack and changes to it.
+ *
+ * @param const vector<string>& the args with which to call 'popd'
+ * @return -1 if invalid syntax, empty stack, or system call failure, 0 otherwise
+ */
+int popd_builtin(const vector<string>&);
+
+/**
+ * Prints the directory stack, beginning with the current working directory. With -c,
+ * clears the stack instead.
+ *
+ * @param const vector<string>& the args with which to call 'dirs'
+ * @return -1 if invalid syntax, 0 otherwise
+ */
+int dirs_builtin(const vector<string>&);
+
+/**
+ * Jumps to the most frecent (frequently and recently visited) directory matching all of
+ * the given terms. With -l (or no terms), lists the matches and their scores instead. With
+ * -x, removes the current directory from the index.
+ *
+ * @param const vector<string>& the args with which to call 'z'
+ * @return -1 if invalid syntax, no match, or system call failure, 0 otherwise
+ */
+int z_builtin(const vector<string>&);
+
+/**
+ * Defines an alias for each NAME=VALUE arg, and prints the alias for each NAME arg. With no
+ * args, prints every alias. VALUE is lexed once, here, and its tokens are spliced into the
+ * token stream whenever NAME is found at a command position.
+ *
+ * @param const vector<string>& the args with which to call 'alias'
+ * @return -1 if invalid syntax or an undefined NAME, 0 otherwise
+ */
+int alias_builtin(const vector<string>&);
+
+/**
+ * Removes the alias for each NAME arg. With -a, removes every alias.
+ *
+ * @param const vector<string>& the args with which to call 'unalias'
+ * @return -1 if invalid syntax or an undefined NAME, 0 otherwise
+ */
+int unalias_builtin(const vector<string>&);
+
+/**
+ * Enables (-o) or disables (+o) the given shell option. With no args, or just -o,
+ * prints the state of every option.
+ *
+ * @param const vector<string>& the args with which to call 'set'
+ * @return -1 if invalid syntax or an unknown option, 0 otherwise
+ */
+int set_builtin(const vector<string>&);
+
 /**
  * Changes the specified environment variable to given value. If the variable doesn't
  * exist yet, it is created and given the value of an empty string. 
@@ -303,19 +829,327 @@ int jobs_builtin(const vector<string>&);
  */
 int kill_builtin(const vector<string>&);
 
+/**
+ * Does nothing, successfully. Registered as both 'true' and ':'.
+ *
+ * @param const vector<string>& the args with which to call 'true'
+ * @return 0
+ */
+int true_builtin(const vector<string>&);
+
+/**
+ * Does nothing, unsuccessfully.
+ *
+ * @param const vector<string>& the args with which to call 'false'
+ * @return -1
+ */
+int false_builtin(const vector<string>&);
+
+/**
+ * Waits for the sum of the given durations (NUMBER[smhd]) on the shell's event loop, so
+ * that job notifications are still printed while it waits. Interrupted by ^C.
+ *
+ * @param const vector<string>& the args with which to call 'sleep'
+ * @return -1 if invalid syntax or interrupted, 0 otherwise
+ */
+int sleep_builtin(const vector<string>&);
+
+/**
+ * Prints the stalls recorded by the watchdog: times when the REPL took longer than $STALL_MS
+ * (default 1000) milliseconds to get back to the prompt without a foreground job running.
+ * With -c, forgets them.
+ *
+ * @param const vector<string>& the args with which to call 'stalls'
+ * @return -1 if invalid syntax or the shell isn't interactive, 0 otherwise
+ */
+int stalls_builtin(const vector<string>&);
+
+/**
+ * Prints NAME with any leading directory components (and SUFFIX, if given) removed.
+ *
+ * @param const vector<string>& the args with which to call 'basename'
+ * @return -1 if invalid syntax, 0 otherwise
+ */
+int basename_builtin(const vector<string>&);
+
+/**
+ * Prints the given args, separated by spaces and followed by a newline (unless -n is given).
+ *
+ * @param const vector<string>& the args with which to call 'echo'
+ * @return 0
+ */
+int echo_builtin(const vector<string>&);
+
+/**
+ * Queues a command in the spool directory $SPOOL (~/.1730sh_spool by default), or the one
+ * given with -d, to be run later by "1730sh --drain". The args are joined with spaces into
+ * the command line that is queued, as is, so a quoted pipeline or redirect (e.g., 'enqueue
+ * "make > log"') is parsed by the drainer. Takes one write() and fdatasync() to a file kept
+ * open between calls.
+ *
+ * @param const vector<string>& the args with which to call 'enqueue'
+ * @return -1 if invalid syntax or the spool can't be written, 0 otherwise
+ */
+int enqueue_builtin(const vector<string>&);
+
+/**
+ * Prints the given args according to FORMAT, like printf(1). Supports the escapes \n, \t,
+ * \\ and \", and the conversions %s, %b, %c, %d, %i, %u, %o, %x, %X, %e, %f, %g and %%, with
+ * flags, width and precision. FORMAT is reused until every arg has been consumed.
+ *
+ * @param const vector<string>& the args with which to call 'printf'
+ * @return -1 if invalid syntax or a number is invalid, 0 otherwise
+ */
+int printf_builtin(const vector<string>&);
+
+/**
+ * Prints NAME with its last component removed.
+ *
+ * @param const vector<string>& the args with which to call 'dirname'
+ * @return -1 if invalid syntax, 0 otherwise
+ */
+int dirname_builtin(const vector<string>&);
+
+/**
+ * Prints the value of each given environment variable, or of every one if none are given.
+ *
+ * @param const vector<string>& the args with which to call 'printenv'
+ * @return -1 if any variable is not set, 0 otherwise
+ */
+int printenv_builtin(const vector<string>&);
+
+/**
+ * Samples the shell's own stacks (see Sampler.h): 'profile start [HZ]' starts sampling,
+ * 'profile stop' stops it, and 'profile dump' prints the samples taken as folded stacks.
+ * With no args, prints whether the sampler is running and how many samples it has.
+ *
+ * @param const vector<string>& the args with which to call 'profile'
+ * @return -1 if invalid syntax or the sampler can't be started, 0 otherwise
+ */
+int profile_builtin(const vector<string>&);
+
+/**
+ * Reads a line from stdin, one byte at a time so nothing after it is consumed, and splits it
+ * on whitespace into the given environment variables. The last one gets the rest of the
+ * line. With no NAME, the whole line is stored in REPLY.
+ *
+ * @param const vector<string>& the args with which to call 'read'
+ * @return -1 at EOF or upon system call failure, 0 otherwise
+ */
+int read_builtin(const vector<string>&);
+
+/**
+ * The shell's event loop. Waits for up to the given number of seconds, printing job
+ * notifications whenever a child changes state (SIGCHLD). Returns early upon ^C.
+ *
+ * @param double the number of seconds to wait
+ * @return -1 if interrupted by ^C, 0 otherwise
+ */
+int event_wait(double);
+
 // GLOBALS
 
+// how many upcoming commands of a script are read ahead of the one running
+const unsigned int READAHEAD_DEPTH = 4;
+
+// default sampling rate of 'profile start', prime so it doesn't run in lockstep with timers
+const unsigned int PROFILE_HZ = 997;
+
+// default milliseconds the REPL may take to get back to the prompt before it is a stall
+const unsigned int STALL_MS = 1000;
+
+// markers of a command substitution in a line being lexed: outside and inside double-quotes
+const char SUB_WORDS = '\x01';
+const char SUB_QUOTED = '\x02';
+
+const char * SHELL_VERSION = "1730sh 1.1";
+
 int last_exit_status = EXIT_SUCCESS;
+bool job_control = true;
+bool report_jobs = true; // print the status of foreground jobs when they finish
+bool rc_recording = false;
+bool rc_cacheable = true;
+set<string> rc_exports; // the names exported while rc_recording
+
+// shell options, toggled with 'set -o NAME' / 'set +o NAME'
+map<string, bool> shell_options{
+  {"pipeopt", false}, // rewrite redundant pipeline stages
+  {"lastpipe", true}, // run a builtin at the end of a foreground pipeline in the shell, without job control
+  {"readahead", true}, // read executables into the page cache before exec
+  {"readahead-libs", false}, // ...and their shared libraries
+  {"subreaper", false}, // adopt and reap orphaned descendants of jobs
+};
 int shell_terminal = STDIN_FILENO;
 pid_t shell_pgid = getpgrp();
 vector<Input*> current_jobs{};
+string logical_pwd = "/";
+vector<string> dir_stack{};
+
+// relays between jobs and the files they write to, for checksum and timestamp redirects
+struct OutputRelay {
+  Input * job;
+  RelayFilter * filter;
+  Digest * digest; // the filter, if it computes a checksum, or nullptr
+  string file;
+  string var; // the variable to store the digest in, or "" for a sidecar file
+  thread worker;
+  int error = 0; // errno of the relay, if it failed
+  mutex lock;
+  condition_variable finished;
+  bool done = false; // set by worker once the file is closed
+}; // OutputRelay
+vector<OutputRelay *> output_relays;
+// the most milliseconds to wait for a finished job's relays to drain before detaching them
+const int64_t RELAY_WAIT_MS = 100;
+
+// builtins and $PATH executables, for "did you mean" suggestions. built on first use
+CommandIndex * command_index = nullptr;
+
+// the spool written to by 'enqueue', kept open between calls
+Spool * spool = nullptr;
+
+// CDPATH candidate cache
+struct DirCacheEntry {
+  bool isDir;
+  time_t checked;
+}; // DirCacheEntry
+
+// lives in the cache arena, so forks don't copy it; never destroyed, so that a child
+// which exit()s doesn't walk memory it didn't inherit. adopt_caches() gives children a new one
+typedef map<arena_string, DirCacheEntry, ArenaLess,
+	    ArenaAllocator<pair<const arena_string, DirCacheEntry>>> DirCache;
+const time_t CDPATH_NEG_TTL = 2;
+DirCache * cdpath_cache = new DirCache();
+
+// frecency index of visited dirs, used by 'z'
+Frecency * frecency = nullptr;
+
+// asynchronous prompt segments, created when $PROMPT first uses one
+PromptSegments * prompt_segments = nullptr;
+
+// watches the REPL for stalls. only started by an interactive shell
+Watchdog * watchdog = nullptr;
+
+// writes cout to the terminal on its own thread, when interactive. cout_direct is the
+// original buffer, used while a builtin's stdout is redirected and by forked children
+TermWriter * term_writer = nullptr;
+streambuf * cout_direct = nullptr;
+// the most milliseconds to wait for queued output to reach the terminal before a job, and at exit
+const int64_t TERM_DRAIN_MS = 100;
+const int64_t TERM_EXIT_DRAIN_MS = 1000;
+
+// profile of a script run with --profile[=FILE]
+Profiler * profiler = nullptr;
+string profile_path = "";
+
+// progress journal of a script run with --journal FILE [--resume]
+Journal * journal = nullptr;
+bool journal_resume = false;
+
+// descendants of jobs, tracked while the shell is a subreaper
+struct Descendant {
+  pid_t jid = 0;           // the job it descends from, or 0 if unknown
+  string job;              // the job's command line
+  string comm;             // the process's own name
+  bool orphaned = false;   // reparented to the shell
+  bool reaped = false;
+  int status = 0;
+  struct rusage usage;
+}; // Descendant
+
+map<pid_t, Descendant> descendants{};
+// the fewest milliseconds between two scans of all of /proc, where the kernel doesn't list
+// each process's children
+const int64_t TRACK_SCAN_MS = 1000;
+
+// exits that were summarized instead of printed, for 'jobs -x'
+const size_t NOTIFY_LIMIT = 10;
+const size_t EXITED_LOG_MAX = 100000;
+deque<string> exited_log{};
+
+// the builtin table. 'exit' is listed so it is recognized, but callBuiltIn() handles it
+typedef int (*builtin_fn)(const vector<string>&);
+const map<string, builtin_fn> builtins{
+  {":", true_builtin},
+  {"alias", alias_builtin},
+  {"basename", basename_builtin},
+  {"bg", bg_builtin},
+  {"cd", cd_builtin},
+  {"dirname", dirname_builtin},
+  {"dirs", dirs_builtin},
+  {"echo", echo_builtin},
+  {"enqueue", enqueue_builtin},
+  {"exit", exit_builtin},
+  {"export", export_builtin},
+  {"false", false_builtin},
+  {"fg", fg_builtin},
+  {"help", help_builtin},
+  {"jobs", jobs_builtin},
+  {"kill", kill_builtin},
+  {"popd", popd_builtin},
+  {"printenv", printenv_builtin},
+  {"printf", printf_builtin},
+  {"profile", profile_builtin},
+  {"pushd", pushd_builtin},
+  {"pwd", pwd_builtin},
+  {"read", read_builtin},
+  {"set", set_builtin},
+  {"sleep", sleep_builtin},
+  {"stalls", stalls_builtin},
+  {"true", true_builtin},
+  {"unalias", unalias_builtin},
+  {"z", z_builtin},
+};
 
 // MAIN
 
 int main(int argc, char * argv[]) {
 
+  // parses command-line options. a remaining arg is a script to run non-interactively
+  bool use_rc = true;
+  string script = "";
+  string journal_path = "";
+  bool usage = false;
+  bool profile = false;
+  string drain_dir = "";
+  long slots = 1;
+  for(int i = 1; i < argc; i++) {
+    if(string(argv[i]) == "--norc") {
+      use_rc = false;
+    } else if(string(argv[i]) == "--journal" && i + 1 < argc) {
+      journal_path = argv[++i];
+    } else if(string(argv[i]) == "--resume") {
+      journal_resume = true;
+    } else if(string(argv[i]) == "--profile") {
+      profile = true;
+    } else if(string(argv[i]).compare(0, 10, "--profile=") == 0 && argv[i][10] != '\0') {
+      profile = true;
+      profile_path = argv[i] + 10;
+    } else if(string(argv[i]) == "--drain" && i + 1 < argc) {
+      drain_dir = argv[++i];
+    } else if(string(argv[i]) == "-j" && i + 1 < argc) {
+      char * end;
+      slots = strtol(argv[++i], &end, 10);
+      if(*end != '\0' || slots < 1) usage = true;
+    } else if(script == "" && argv[i][0] != '-') {
+      script = argv[i];
+    } else {
+      usage = true;
+    } // if/else
+  } // for
+  if(usage || ((journal_path != "" || profile) && script == "") || (journal_resume && journal_path == "") ||
+     (drain_dir != "" && script != "") || (slots != 1 && drain_dir == "")) {
+    cout << "Usage: 1730sh [--norc] [--journal FILE [--resume]] [--profile[=FILE]] [SCRIPT]" << endl;
+    cout << "       1730sh [--norc] --drain SPOOLDIR [-j N]" << endl;
+    return EXIT_FAILURE;
+  } // if
+  if(journal_path != "") journal = new Journal(journal_path);
+  if(profile) profiler = new Profiler(script);
+  job_control = isatty(shell_terminal) && drain_dir == "";
+  bool interactive = (script == "" && drain_dir == "");
+
   // prints shell logo
-  print_logo();
+  if(interactive) print_logo();
 
   // set job control signal dispositions to SIG_IGN
   parent_signals();
@@ -323,186 +1157,826 @@ int main(int argc, char * argv[]) {
   cout.setf(std::ios::unitbuf);
   cin.setf(std::ios::unitbuf);
 
-  // changes to user's home dir upon shell init
-  chdir_home();
+  // a terminal that stops reading only blocks the writer thread, not the REPL
+  if(interactive && isatty(STDOUT_FILENO)) {
+    term_writer = new TermWriter(STDOUT_FILENO);
+    if(term_writer->isOpen()) {
+      cout_direct = cout.rdbuf(term_writer);
+    } else {
+      delete term_writer;
+      term_writer = nullptr;
+    } // if/else
+  } // if
+
+  // changes to user's home dir upon shell init. scripts and drains run where they were started
+  if(interactive) {
+    chdir_home();
+  } else {
+    char cwd[PATH_MAX];
+    const char * pwd = getenv("PWD");
+    if(getcwd(cwd,sizeof(cwd)) == nullptr) { nope_out("getcwd"); } // if
+    // keeps the inherited logical $PWD if it still refers to the cwd
+    struct stat sb_pwd, sb_cwd;
+    if(pwd != nullptr && pwd[0] == '/' && stat(pwd,&sb_pwd) == 0 && stat(cwd,&sb_cwd) == 0 &&
+       sb_pwd.st_dev == sb_cwd.st_dev && sb_pwd.st_ino == sb_cwd.st_ino) {
+      logical_pwd = lexical_path(string(pwd));
+    } else {
+      logical_pwd = string(cwd);
+    } // if/else
+    setenv("PWD", logical_pwd.c_str(), 1);
+  } // if/else
+
+  // frecency index lives in $Z_DATA, or ~/.1730sh_z by default
+  const char * z_data = getenv("Z_DATA");
+  frecency = new Frecency((z_data != nullptr) ? string(z_data) : home_path(".1730sh_z"));
+
+  // command resolutions and script plans are shared by all instances through /dev/shm
+  string cache_path = SharedCache::defaultPath();
+  if(cache_path != "") shared_cache = SharedCache::open(cache_path);
+
+  // restores the state left by ~/.1730shrc, from its snapshot if possible
+  if(use_rc) load_rc(home_path(".1730shrc"));
+
+  if(script != "") {
+    exit_shell(run_script(script));
+  } else if(drain_dir != "") {
+    exit_shell(drain_spool(drain_dir, slots));
+  } // if/else
 
   string input = "";
-  bool hangingPipe = false;
-  bool hangingQuote = false;
-  
+
+  watchdog = new Watchdog(STALL_MS);
+
   // begin REPL loop
   while(1) { // exits when ^C
 
+    const char * stall_ms = getenv("STALL_MS");
+    watchdog->setThreshold((stall_ms != nullptr && isdigit(stall_ms[0])) ? strtoul(stall_ms, nullptr, 10) : STALL_MS);
+
     // polls all of the currently running jobs for status changes
+    watch_busy("check_current_jobs");
     check_current_jobs();
-    
-    // prompt
-    if(!hangingPipe && !hangingQuote) {
-      prompt();
-    } else {
-      cout << "> ";
-    } // if/else
 
-    // only reset input if not waiting on more (due to hanging pipe OR hanging quote). otherwise, append to it.
-    if(!hangingPipe && !hangingQuote) {
-      input = "";
-      getline(cin,input);
-      input = trim(input);
-    } else {
-      string tmp = "";
-      getline(cin,tmp);
-      tmp = trim(tmp);
-      if(hangingQuote) {
-	input = input + tmp;
-      } else if(hangingPipe) {
-	input = input + " " + tmp;
-      } // if/else
-    } // if/else
+    // writes out batched 'z' records between commands, never during cd itself
+    watch_busy("frecency flush");
+    if(frecency->needsFlush()) frecency->flush();
+
+    // prompt. if segments are still being computed, redraws it as they arrive, until the
+    // deadline or the user ends a line (cin only buffers whole lines from a terminal)
+    watch_busy("prompt");
+    string shown;
+    bool redraw = prompt(shown);
+    cout << shown;
+    watch_idle("input");
+    if(redraw && job_control && cin.rdbuf()->in_avail() == 0) {
+      struct timespec start, now;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      bool pending = true;
+      while(pending) {
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long left = PromptSegments::DEADLINE_MS + 50 -
+	  ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+	struct pollfd pfds[2] = {{STDIN_FILENO, POLLIN, 0}, {prompt_segments->notifyFd(), POLLIN, 0}};
+	int n = (left > 0) ? poll(pfds, 2, left) : 0;
+	if(n == -1 && errno == EINTR) continue; // e.g., SIGPROF while 'profile' is running
+	if(n <= 0 || (pfds[0].revents & POLLIN)) break;
+	prompt_segments->drainNotify();
+	watch_busy("prompt redraw");
+	string next;
+	pending = prompt(next);
+	redraw_prompt(shown, next);
+	shown = next;
+	watch_idle("input");
+      } // while
+    } // if
+
+    // reads a full command, prompting for more on a hanging pipe or quote
+    if(!read_command(cin, input, true)) {
+      cout << endl;
+      exit_shell(last_exit_status);
+    } // if
 
     // user just hit [enter]
     if(input == "") continue;
 
-    // if user input actually contains something, check if valid
-    if(isValidInput(input)) {
+    watch_busy("run_line");
+    run_line(input);
+
+    // the command may have changed what the segments show
+    watch_busy("prompt invalidate");
+    if(prompt_segments != nullptr) prompt_segments->invalidate(environ_list());
+  } // while
+  return EXIT_SUCCESS;
+} // main
+
+// DEFINITIONS
+
+bool read_command(istream & in, string & input, bool interactive, unsigned int * lines) {
+  bool hangingPipe = false;
+  bool hangingQuote = false;
+  input = "";
+  do {
+    string tmp = "";
+    if(hangingPipe || hangingQuote) {
+      if(interactive) cout << "> ";
+    } // if
+    if(!getline(in,tmp)) return false;
+    if(lines != nullptr) (*lines)++;
+    tmp = trim(tmp);
+    // only reset input if not waiting on more (due to hanging pipe OR hanging quote). otherwise, append to it.
+    if(hangingQuote) {
+      input = input + tmp;
+    } else if(hangingPipe) {
+      input = input + " " + tmp;
+    } else {
+      input = tmp;
+    } // if/else
+    hangingPipe = false;
+    hangingQuote = false;
+    if(input != "" && isValidInput(input)) {
       if(hasQuotes(input) && !hasEvenQuotes(input)) {
 	hangingQuote = true;
-	continue;
-      } // if
-      hangingQuote = false;
-      if(input[input.length()-1] == '|') {
+      } else if(input[input.length()-1] == '|') {
 	hangingPipe = true;
-	continue;
-      } // if
-      hangingPipe = false;
-
-      // if finally have valid input AND no hanging pipes/quotes, make Input obj and do stuff
-      Input * job = new Input(input);
-      int ** pipes = makePipes(job->getNumPipes());
-      int fd_STDIN = STDIN_FILENO;
-      int fd_STDOUT = STDOUT_FILENO;
-      int fd_STDERR = STDERR_FILENO;
-      int pid; 
+      } // if/else
+    } // if
+  } while(hangingPipe || hangingQuote);
+  return true;
+} // read_command
+
+void run_line(string input, const vector<string> * tokens) {
+  string marked = input; // the input as lexed: command substitutions are run after lexing
+  vector<string> commands;
+  if(input.find("$(") != string::npos) {
+    if(mark_substitutions(marked, commands) == -1) {
+      cout << "1730sh: unterminated command substitution" << endl;
+      last_exit_status = EXIT_FAILURE;
+      return;
+    } // if
+    tokens = nullptr; // lexed with the substitutions unmarked
+  } // if
+  // if user input actually contains something, check if valid
+  if(tokens != nullptr || isValidInput(marked)) {
+
+    vector<string> expanded;
+    if(!commands.empty()) {
+      if(expand_substitutions(marked, commands, expanded) == -1) return; // already reported
+      tokens = &expanded;
+    } // if
+    // if finally have valid input AND no hanging pipes/quotes, make Input obj and do stuff
+    double parse_start = (profiler != nullptr) ? Profiler::now() : 0;
+    Input * job = (tokens != nullptr) ? new Input(input, *tokens) : new Input(input);
+    if(job->getProcesses().empty()) { delete job; return; } // if
+    if(shell_options["pipeopt"] && job->getProcesses().size() > 1) {
+      vector<string> rewrites = optimize_pipeline(job);
+      for(unsigned int i = 0; i < rewrites.size(); i++) {
+	cerr << "1730sh: pipeopt: " << rewrites[i] << endl;
+      } // for
+    } // if
+    if(profiler != nullptr) {
+      profiler->addParse(Profiler::now() - parse_start);
+      vector<string> names;
+      for(const Process & p : job->getProcesses()) names.push_back(p.args[0]);
+      profiler->setCommands(names);
+    } // if
+    int ** pipes = makePipes(job->getNumPipes());
+    int fd_STDIN = STDIN_FILENO;
+    int fd_STDOUT = STDOUT_FILENO;
+    int fd_STDERR = STDERR_FILENO;
+    int pid; 
       
-      // sets and/or creates the destinations for any i/o redirection. default is STD[IN/OUT/ERR]_FILENO
-      if(set_redirects(job,fd_STDIN,fd_STDOUT,fd_STDERR) == -1) { delete job; continue; } // if
+    // sets and/or creates the destinations for any i/o redirection. default is STD[IN/OUT/ERR]_FILENO
+    if(set_redirects(job,fd_STDIN,fd_STDOUT,fd_STDERR) == -1) {
+      last_exit_status = EXIT_FAILURE;
+      finish_output_relays(job);
+      delete job;
+      return;
+    } // if
 
-      // command is either built-in || has no pipes
-      if(job->getProcesses().size() == 1) {
-	string command = job->getProcesses()[0].args[0];
-	if(isBuiltIn(command)) { // does not involve fork/exec
+    // command is either built-in || has no pipes
+    if(job->getProcesses().size() == 1) {
+      string command = job->getProcesses()[0].args[0];
+      // a backgrounded builtin that also exists as a program (e.g., 'sleep 5 &') runs as the program
+      string resolved = resolve_command(command); // once, for the child to exec too
+      bool background_util = (!job->isForeground() && resolved != "");
+      if(isBuiltIn(command) && !background_util) { // does not involve fork/exec
+	int saved[3];
+	do_shell_redirects(fd_STDIN,fd_STDOUT,fd_STDERR,saved);
+	close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
+	if(rc_recording && !isSnapshotSafe(command)) rc_cacheable = false;
+	callBuiltIn(command, job->getProcesses()[0].args, nullptr);
+	restore_redirects(saved);
+	finish_output_relays(job);
+	delete job;
+	return;
+      } else { // involves fork/exec
+	rc_cacheable = false;
+	if(command.find('/') == string::npos && !background_util && resolved == "") {
+	  // known not to exist, so there is nothing to fork for
+	  cout << "1730sh: " << command << ": command not found" << endl;
+	  vector<string> suggestions = suggest_commands(command);
+	  if(!suggestions.empty()) {
+	    cout << "1730sh: did you mean";
+	    for(unsigned int i = 0; i < suggestions.size(); i++) cout << ((i == 0) ? " " : ", ") << suggestions[i];
+	    cout << "?" << endl;
+	  } // if
+	  last_exit_status = EXIT_FAILURE;
+	  close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
+	  finish_output_relays(job); // its relays must not outlive it
+	  delete job;
+	  return;
+	} // if
+	readahead_commands({resolved});
+	drain_terminal();
+	if((pid = timed_fork()) == -1) {
+	  nope_out("fork");
+	} else if(pid == 0) { // in child
+	  child_signals(); // resets signal dispositions back to default
+	  job->getProcesses()[0].PID = getpid(); // sets pid for bookkeeping
+	  job->setJID(getpid()); // sets JID/PGID of current Input obj/Processes for bookkeeping
+	  if(setpgid(getpid(),job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
+	  if(job->isForeground() && job_control) {
+	    if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } // makes JID the foreground pgrp of the terminal
+	  } // if
 	  do_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
 	  close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
-	  callBuiltIn(command, job->getProcesses()[0].args, job);
-	  continue;
-	} else { // involves fork/exec
-	  if((pid = fork()) == -1) {
-	    nope_out("fork");
-	  } else if(pid == 0) { // in child
-	    child_signals(); // resets signal dispositions back to default
-	    job->getProcesses()[0].PID = getpid(); // sets pid for bookkeeping
-	    job->setJID(getpid()); // sets JID/PGID of current Input obj/Processes for bookkeeping
-	    if(setpgid(getpid(),job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
-	    if(job->isForeground()) {
-	      if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } // makes JID the foreground pgrp of the terminal
-	    } // if
-	    do_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
-	    close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
-	    nice_exec(job->getProcesses()[0].args, pipes, job->getNumPipes());
-	  } else { // in parent
-	    job->getProcesses()[0].PID = pid; // sets pid for bookkeeping
-	    job->setJID(pid); // sets JID/PGID of current Input obj/Processes for bookkeeping
-	    if(setpgid(pid,job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
-	  } // if/else
-	  // after job has been launched
-	  current_jobs.push_back(job); // add to vector of currently running jobs
+	  nice_exec(job->getProcesses()[0].args, pipes, job->getNumPipes(), resolved);
+	} else { // in parent
+	  job->getProcesses()[0].PID = pid; // sets pid for bookkeeping
+	  job->setJID(pid); // sets JID/PGID of current Input obj/Processes for bookkeeping
+	  if(setpgid(pid,job->getJID()) == -1 && errno != EACCES) { nope_out("setpgid"); } // sets pgid of process in system (EACCES: child already exec()ed)
 	} // if/else
-      } else { // command is a pipelined job
-	for(unsigned int i = 0, size = job->getProcesses().size(); i < size; i++) {
-	  if(i != size-1) { // not last process
-	    if(pipe(pipes[i]) == -1) { nope_out("pipe"); } // if
-	  } // if
-	  if((pid = fork()) == -1) {
-	    nope_out("fork");
-	  } else if(pid == 0) { // in child
-	    job->getProcesses()[i].PID = getpid(); // sets pid for bookkeeping
-	    if(i == 0) { job->setJID(getpid()); } // sets JID/PGID of current Input obj/Processes for bookkeeping
-	    if(setpgid(getpid(),job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
-	    if(job->isForeground()) {
-	      if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } // makes JID the foreground pgrp of the terminal
-	    } // if
-	    child_signals(); // reset signal dispositions back to default
-	    if(i == 0) { // first process
-	      do_redirects(fd_STDIN,pipes[i][1],-1);
-	      close_pipe(pipes[i],true);
-	    } else if(i != size-1) { // some middle process
-	      do_redirects(pipes[i-1][0],pipes[i][1],-1);
-	      close_pipe(pipes[i-1],true);
-	      close_pipe(pipes[i],true);
-	    } else if(i == size-1) { // last process
-	      do_redirects(pipes[i-1][0],fd_STDOUT,fd_STDERR);
-	      close_pipe(pipes[i-1],true);
-	    } // if/else
-	    close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
-	    nice_exec(job->getProcesses()[i].args, pipes, job->getNumPipes());
-	  } else { // in parent
-	    job->getProcesses()[i].PID = pid; // sets pid for bookkeeping
-	    if(i == 0) { job->setJID(pid); } // sets JID/PGID of current Input obj/Processes
-	    if(setpgid(pid,job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
-	    if(i != 0) {
-	      close_pipe(pipes[i-1],true);
-	    } // if
-	  } // if/else	
-	} // for	
 	// after job has been launched
 	current_jobs.push_back(job); // add to vector of currently running jobs
       } // if/else
+    } else { // command is a pipelined job
+      rc_cacheable = false;
+      // a builtin at the end of a foreground pipeline runs in the shell, reading from the
+      // pipe, so whatever state it changes (e.g., 'read' setting variables) is kept. Not with
+      // job control: a stopped job would keep the pipe open, and the shell would block on it
+      string last = job->getProcesses().back().args[0];
+      bool lastpipe = shell_options["lastpipe"] && !job_control && job->isForeground() && isBuiltIn(last);
+      unsigned int forked = job->getProcesses().size() - ((lastpipe) ? 1 : 0);
+      vector<string> resolved;
+      for(unsigned int i = 0; i < forked; i++) resolved.push_back(resolve_command(job->getProcesses()[i].args[0]));
+      readahead_commands(resolved);
+      drain_terminal(); // once, not for every stage
+      for(unsigned int i = 0, size = job->getProcesses().size(); i < forked; i++) {
+	if(i != size-1) { // not last process
+	  if(pipe(pipes[i]) == -1) { nope_out("pipe"); } // if
+	} // if
+	if((pid = timed_fork()) == -1) {
+	  nope_out("fork");
+	} else if(pid == 0) { // in child
+	  job->getProcesses()[i].PID = getpid(); // sets pid for bookkeeping
+	  if(i == 0) { job->setJID(getpid()); } // sets JID/PGID of current Input obj/Processes for bookkeeping
+	  if(setpgid(getpid(),job->getJID()) == -1) { nope_out("setpgid"); } // sets pgid of process in system
+	  if(job->isForeground() && job_control) {
+	    if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } // makes JID the foreground pgrp of the terminal
+	  } // if
+	  child_signals(); // reset signal dispositions back to default
+	  if(i == 0) { // first process
+	    do_redirects(fd_STDIN,pipes[i][1],-1);
+	    close_pipe(pipes[i],true);
+	  } else if(i != size-1) { // some middle process
+	    do_redirects(pipes[i-1][0],pipes[i][1],-1);
+	    close_pipe(pipes[i-1],true);
+	    close_pipe(pipes[i],true);
+	  } else if(i == size-1) { // last process
+	    do_redirects(pipes[i-1][0],fd_STDOUT,fd_STDERR);
+	    close_pipe(pipes[i-1],true);
+	  } // if/else
+	  close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
+	  nice_exec(job->getProcesses()[i].args, pipes, job->getNumPipes(), resolved[i]);
+	} else { // in parent
+	  job->getProcesses()[i].PID = pid; // sets pid for bookkeeping
+	  if(i == 0) { job->setJID(pid); } // sets JID/PGID of current Input obj/Processes
+	  if(setpgid(pid,job->getJID()) == -1 && errno != EACCES) { nope_out("setpgid"); } // sets pgid of process in system (EACCES: child already exec()ed)
+	  if(i != 0) {
+	    close_pipe(pipes[i-1],true);
+	  } // if
+	} // if/else	
+      } // for	
+      if(lastpipe) {
+	int * pipefd = pipes[forked-1];
+	vector<string> args = job->getProcesses().back().args;
+	job->getProcesses().pop_back(); // the job is now just the stages before it
+	if(close(pipefd[1]) == -1) nope_out("close");
+	int saved[3];
+	do_shell_redirects(pipefd[0],fd_STDOUT,fd_STDERR,saved);
+	if(close(pipefd[0]) == -1) nope_out("close");
+	current_jobs.push_back(job);
+	callBuiltIn(last, args, nullptr);
+	restore_redirects(saved);
+	int status = last_exit_status;
+	close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR);
+	deletePipes(pipes,job->getNumPipes());
+	put_job_in_foreground(job,false);
+	last_exit_status = status; // the pipeline's status is its last stage's
+	return;
+      } // if
+      // after job has been launched
+      current_jobs.push_back(job); // add to vector of currently running jobs
+    } // if/else
       
-      close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR); // close i/o redirect fd's
-      deletePipes(pipes,job->getNumPipes()); // delete dynamically-allocated pipefd[2] array
+    close_redirects(fd_STDIN,fd_STDOUT,fd_STDERR); // close i/o redirect fd's
+    deletePipes(pipes,job->getNumPipes()); // delete dynamically-allocated pipefd[2] array
 
-      // waits on last child of job if in foreground. if in background, it doesnt.
-      if(job->isForeground()) {
-	put_job_in_foreground(job,false);
+    // waits on last child of job if in foreground. if in background, it doesnt.
+    if(job->isForeground()) {
+      put_job_in_foreground(job,false);
+    } else {
+      put_job_in_background(job,false);
+    } // if/else
+  } else { // invalid syntax
+    cout << "./1730sh: Invalid command syntax" << endl;
+    last_exit_status = EXIT_FAILURE;
+  } // if/else
+} // run_line
+
+pid_t timed_fork() {
+  double start = (profiler != nullptr) ? Profiler::now() : 0;
+  pid_t pid = fork();
+  if(pid == 0 && term_writer != nullptr) {
+    if(cout.rdbuf() == term_writer) cout.rdbuf(cout_direct);
+    term_writer = nullptr; // its thread is the parent's
+  } // if
+  if(pid != 0 && profiler != nullptr) profiler->addFork(Profiler::now() - start);
+  return pid;
+} // timed_fork
+
+void drain_terminal() {
+  if(term_writer != nullptr) term_writer->drain(TERM_DRAIN_MS);
+} // drain_terminal
+
+void adopt_caches() {
+  // the parent's caches are abandoned, not destroyed: they aren't mapped here
+  Arena::caches().forget();
+  cdpath_cache = new DirCache();
+  if(frecency != nullptr) frecency = new Frecency(frecency->path());
+} // adopt_caches
+
+int run_script(const string & path) {
+  ifstream in(path, ios::binary);
+  if(!in) {
+    cout << "1730sh: " << path << ": " << strerror(errno) << endl;
+    return 127;
+  } // if
+  string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  in.close(); // before any job is launched, so none of them inherits the script's fd
+  istringstream script(contents);
+  if(journal != nullptr) {
+    int res = journal->open(fnv1a(contents.data(), contents.size()), journal_resume);
+    if(res == -1) {
+      cout << "1730sh: journal: " << strerror(errno) << endl;
+      return EXIT_FAILURE;
+    } else if(res == 1) {
+      cout << "1730sh: journal: written for a different version of " << path << ", starting over" << endl;
+    } // if/else
+  } // if
+  bool skipping = journal_resume;
+  unsigned int lineno = 0;
+  // commands are read, lexed and validated on a helper thread while earlier ones run
+  Lookahead lookahead([&script, &lineno](ScriptLine & cmd) {
+      do {
+	cmd.line = lineno + 1;
+	if(!read_command(script, cmd.input, false, &lineno)) return false;
+      } while(cmd.input == "" || cmd.input[0] == '#'); // blank line or comment
+      cmd.valid = isValidInput(cmd.input);
+      if(cmd.valid) cmd.tokens = lex(cmd.input);
+      cmd.hash = fnv1a(cmd.input.data(), cmd.input.size());
+      return true;
+    });
+  // a few of them are taken early, so their executables can be read into the page cache
+  // while the one before them runs
+  deque<ScriptLine> upcoming;
+  bool eof = false;
+  while(true) {
+    while(!eof && upcoming.size() <= READAHEAD_DEPTH) {
+      ScriptLine cmd;
+      if(!lookahead.pop(cmd)) {
+	eof = true;
+	break;
+      } // if
+      upcoming.push_back(std::move(cmd));
+      if(upcoming.size() > 1 && upcoming.back().valid && shell_options["readahead"]) { // the first is read ahead by run_line
+	vector<string> names = command_names(upcoming.back().tokens);
+	if(names.size() == 1 && isBuiltIn(names[0])) continue; // runs in the shell
+	for(unsigned int i = 0; i < names.size(); i++) names[i] = resolve_command(names[i]);
+	readahead_commands(names);
+      } // if
+    } // while
+    if(upcoming.empty()) break;
+    ScriptLine cmd = std::move(upcoming.front());
+    upcoming.pop_front();
+    const string & input = cmd.input;
+    const vector<string> * tokens = (cmd.valid) ? &cmd.tokens : nullptr;
+    check_current_jobs();
+    if(profiler != nullptr) profiler->begin(cmd.line, input);
+    if(journal == nullptr) {
+      run_line(input, tokens);
+      if(profiler != nullptr) profiler->end();
+      continue;
+    } // if
+    bool done = journal->isDone(cmd.line, cmd.hash);
+    vector<string> expanded = cmd.tokens;
+    expandAliases(expanded);
+    string command = (expanded.empty()) ? "" : expanded[0];
+    if(skipping && done) {
+      if(!isStateBuiltin(command)) continue; // finished on a previous run
+      // 'z' goes by frecency data that has changed since, so it goes where it went then
+      string dir = journal->directory(cmd.line, cmd.hash);
+      if(command == "z" && dir != "") {
+	change_dir(dir, false, "z");
+	continue;
+      } // if
+    } else {
+      skipping = false;
+    } // if/else
+    run_line(input, tokens);
+    if(profiler != nullptr) profiler->end();
+    // background jobs aren't waited for, so they are never known to have completed
+    if(!done && last_exit_status == EXIT_SUCCESS && input[input.size()-1] != '&') {
+      string dir = (command == "z") ? logical_pwd : "";
+      if(journal->record(cmd.line, cmd.hash, dir) == -1) cout << "1730sh: journal: " << strerror(errno) << endl;
+    } // if
+  } // while
+  return last_exit_status;
+} // run_script
+
+int drain_spool(const string & dir, unsigned int slots) {
+  Spool queue(dir);
+  int requeued;
+  if(queue.open(false) == -1 || (requeued = queue.recover()) == -1) {
+    cout << "1730sh: " << dir << ": " << strerror(errno) << endl;
+    return EXIT_FAILURE;
+  } // if
+  if(requeued > 0) cout << "1730sh: requeued " << with_commas(requeued) << " unfinished commands" << endl;
+  map<pid_t, SpoolRecord> running;
+  size_t ran = 0, failed = 0;
+  bool more = true;
+  while(true) {
+    while(more && running.size() < slots) {
+      SpoolRecord rec;
+      int res = queue.claim(rec);
+      if(res == -1) {
+	cout << "1730sh: " << dir << ": " << strerror(errno) << endl;
+	more = false;
+	failed++;
+      } // if
+      if(res != 1) {
+	more = false;
+	break;
+      } // if
+      cout.flush();
+      pid_t pid;
+      if((pid = timed_fork()) == -1) {
+	nope_out("fork");
+      } else if(pid == 0) { // in child: a copy of the shell that runs the one command
+	adopt_caches();
+	current_jobs.clear();
+	report_jobs = false;
+	run_line(rec.command);
+	cout.flush();
+	_exit(last_exit_status);
+      } // if/else
+      running[pid] = rec;
+    } // while
+    if(running.empty()) break;
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if(pid == -1) {
+      if(errno == EINTR) continue;
+      nope_out("waitpid");
+    } // if
+    auto it = running.find(pid);
+    if(it == running.end()) continue; // an orphan, when the shell is a subreaper
+    int code = (WIFEXITED(status)) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if(queue.finish(it->second, code) == -1) cout << "1730sh: " << dir << ": " << strerror(errno) << endl;
+    running.erase(it);
+    ran++;
+    if(code != EXIT_SUCCESS) failed++;
+    more = true; // more may have been queued in the meantime
+  } // while
+  cout << "1730sh: drained " << with_commas(ran) << " commands (" << with_commas(failed) << " failed)" << endl;
+  return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+} // drain_spool
+
+void load_rc(const string & path) {
+  // reads and hashes the whole rc file. far cheaper than running it
+  ifstream in(path, ios::binary);
+  if(!in) return;
+  string rc((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  uint64_t stamp = fnv1a(rc.data(), rc.size(), fnv1a(SHELL_VERSION, strlen(SHELL_VERSION)));
+  string snap = path + ".snap";
+  bool loaded = loadSnapshot(snap, stamp, [](char type, const string & key, const string & value) {
+      if(type == 'E') {
+	setenv(key.c_str(), value.c_str(), 1);
+      } else if(type == 'A') { // alias tokens are NUL-separated, so they needn't be re-lexed
+	vector<string> & tokens = aliases[key];
+	alias_generation++;
+	stringstream ss(value);
+	string token;
+	while(getline(ss, token, '\0')) tokens.push_back(token);
+      } else if(type == 'O') {
+	if(shell_options.count(key) != 0) {
+	  shell_options[key] = (value == "1");
+	  apply_option(key);
+	} // if
+      } // if/else
+    });
+  if(loaded) return;
+  // no valid snapshot, so run the rc file and record what it changed
+  rc_exports.clear();
+  rc_recording = true;
+  rc_cacheable = true;
+  stringstream ss(rc);
+  string input = "";
+  while(read_command(ss, input, false)) {
+    if(input == "" || input[0] == '#') continue; // blank line or comment
+    run_line(input);
+  } // while
+  rc_recording = false;
+  if(!rc_cacheable) { // rc has side effects beyond the shell's state, so it must run every time
+    unlink(snap.c_str());
+    return;
+  } // if
+  vector<SnapshotRecord> records;
+  for(const string & name : rc_exports) {
+    const char * value = getenv(name.c_str());
+    if(value != nullptr) records.push_back(SnapshotRecord{'E', name, value});
+  } // for
+  for(auto it = aliases.begin(); it != aliases.end(); ++it) {
+    string value = "";
+    for(unsigned int i = 0; i < it->second.size(); i++) {
+      if(i > 0) value += '\0';
+      value += it->second[i];
+    } // for
+    records.push_back(SnapshotRecord{'A', it->first, value});
+  } // for
+  for(auto it = shell_options.begin(); it != shell_options.end(); ++it) {
+    records.push_back(SnapshotRecord{'O', it->first, (it->second) ? "1" : "0"});
+  } // for
+  saveSnapshot(snap, stamp, records);
+} // load_rc
+
+bool isSnapshotSafe(const string & command) {
+  // built-ins whose only effect is on state that the snapshot can restore
+  return command == "export" || command == "alias" || command == "unalias" || command == "set" ||
+    command == "true" || command == "false" || command == ":";
+} // isSnapshotSafe
+
+bool isStateBuiltin(const string & command) {
+  return command == "cd" || command == "pushd" || command == "popd" || command == "z" ||
+    command == "export" || command == "alias" || command == "unalias" || command == "set";
+} // isStateBuiltin
+
+bool isSubstitutionSafe(const string & command) {
+  return command == "pwd" || command == "echo" || command == "printf" || command == "dirname" ||
+    command == "basename" || command == "printenv" || command == "dirs" || command == "true" ||
+    command == "false" || command == ":";
+} // isSubstitutionSafe
+
+int mark_substitutions(string & input, vector<string> & commands) {
+  for(size_t pos = 0; (pos = input.find("$(", pos)) != string::npos; ) {
+    if(pos > 0 && input[pos-1] == '\\') { // escaped
+      pos += 2;
+      continue;
+    } // if
+    // finds the matching paren, counting any nested ones
+    size_t end = pos + 2;
+    for(int depth = 1; end < input.size(); end++) {
+      if(input[end] == '(') depth++;
+      if(input[end] == ')' && --depth == 0) break;
+    } // for
+    if(end >= input.size()) return -1;
+    // a substitution inside double-quotes is marked as such, since its output isn't split
+    unsigned int quotes = 0;
+    for(size_t i = 0; i < pos; i++) {
+      if(input[i] == '"' && (i == 0 || input[i-1] != '\\')) quotes++;
+    } // for
+    char mark = (quotes % 2 == 0) ? SUB_WORDS : SUB_QUOTED;
+    string marker = mark + to_string(commands.size()) + mark;
+    commands.push_back(input.substr(pos + 2, end - pos - 2));
+    input.replace(pos, end - pos + 1, marker);
+    pos += marker.size();
+  } // for
+  return 0;
+} // mark_substitutions
+
+int expand_substitutions(const string & input, const vector<string> & commands, vector<string> & tokens) {
+  vector<string> outputs;
+  for(const string & command : commands) {
+    string output;
+    if(command_output(command, output) == -1) return -1;
+    output.erase(output.find_last_not_of('\n') + 1);
+    outputs.push_back(output);
+  } // for
+  const char * ws = " \t\n";
+  tokens.clear();
+  for(const string & lexed : lex(input)) {
+    if(lexed.find_first_of(string(1, SUB_WORDS) + SUB_QUOTED) == string::npos) {
+      tokens.push_back(lexed);
+      continue;
+    } // if
+    string token = unmark(lexed);
+    string word;
+    bool pending = false; // whether word is an argument even if empty (e.g., "$(true)")
+    for(size_t i = 0; i < token.size(); i++) {
+      if(token[i] != SUB_WORDS && token[i] != SUB_QUOTED) {
+	word += token[i];
+	pending = true;
+	continue;
+      } // if
+      size_t end = token.find(token[i], i + 1);
+      const string & output = outputs[stoul(token.substr(i + 1, end - i - 1))];
+      if(token[i] == SUB_QUOTED) {
+	word += output;
+	pending = true;
       } else {
-	put_job_in_background(job,false);
+	// splits the output into fields: the first joins what came before it, the last what
+	// comes after it
+	for(size_t pos = 0; pos < output.size(); ) {
+	  size_t start = output.find_first_not_of(ws, pos);
+	  if(start != pos && pending) { // whitespace ends the word
+	    tokens.push_back(LITERAL + word);
+	    word = "";
+	    pending = false;
+	  } // if
+	  if(start == string::npos) break;
+	  pos = min(output.find_first_of(ws, start), output.size());
+	  word += output.substr(start, pos - start);
+	  pending = true;
+	} // for
       } // if/else
-    } else { // invalid syntax
-      cout << "./1730sh: Invalid command syntax" << endl;
-    } // if/else
+      i = end;
+    } // for
+    if(pending) tokens.push_back(LITERAL + word);
+  } // for
+  return 0;
+} // expand_substitutions
+
+int command_output(const string & command, string & output) {
+  output = "";
+  if(trim(command) == "") return 0;
+  if(command.find("$(") == string::npos) { // otherwise, the child runs the inner substitutions
+    if(!isValidInput(trim(command))) return 0;
+    Input job(command);
+    if(job.getProcesses().empty()) return 0;
+    string name = job.getProcesses()[0].args[0];
+    if(job.getProcesses().size() == 1 && isBuiltIn(name) && isSubstitutionSafe(name) &&
+       job.getSTDIN_fd() == "STDIN_FILENO" && job.getSTDOUT_fd() == "STDOUT_FILENO" &&
+       job.getSTDERR_fd() == "STDERR_FILENO") { // no fork: cout is captured in memory
+      ostringstream out;
+      streambuf * old = cout.rdbuf(out.rdbuf());
+      callBuiltIn(name, job.getProcesses()[0].args, nullptr);
+      cout.rdbuf(old);
+      output = out.str();
+      return 0;
+    } // if
+  } // if
+  int fds[2];
+  if(pipe2(fds, O_CLOEXEC) == -1) nope_out("pipe");
+  cout.flush();
+  pid_t pid;
+  if((pid = timed_fork()) == -1) {
+    nope_out("fork");
+  } else if(pid == 0) { // in child: a copy of the shell, with its stdout going to the pipe
+    adopt_caches();
+    if(dup2(fds[1], STDOUT_FILENO) == -1) nope_out("dup2");
+    job_control = false; // stays in the shell's process group, like any child
+    report_jobs = false;
+    current_jobs.clear(); // the shell's jobs are not the child's to check on
+    run_line(command);
+    cout.flush();
+    _exit(last_exit_status);
+  } // if/else
+  close(fds[1]);
+  // waiting on the command, like on a foreground job, isn't a stall
+  watch_idle("command substitution");
+  char buf[4096];
+  ssize_t n;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0 || (n == -1 && errno == EINTR)) {
+    if(n > 0) output.append(buf, n);
   } // while
-  return EXIT_SUCCESS;
-} // main
+  close(fds[0]);
+  int status;
+  while(waitpid(pid, &status, 0) == -1 && errno == EINTR) {}
+  watch_busy("run_line");
+  if(WIFSIGNALED(status)) {
+    cout << "1730sh: command substitution: " << trim(command) << ": " << strsignal(WTERMSIG(status)) << endl;
+    last_exit_status = 128 + WTERMSIG(status);
+    return -1;
+  } // if
+  return 0;
+} // command_output
 
-// DEFINITIONS
+void exit_shell(int status) {
+  frecency->flush();
+  if(profiler != nullptr) {
+    if(profile_path != "") {
+      if(profiler->writeFolded(profile_path) == -1) cerr << "1730sh: " << profile_path << ": " << strerror(errno) << endl;
+    } else {
+      const char * top = getenv("PROFILE_TOP");
+      profiler->report(cerr, (top != nullptr && isdigit(top[0])) ? strtoul(top, nullptr, 10) : 10);
+    } // if/else
+    delete profiler;
+    profiler = nullptr;
+  } // if
+  delete journal; // syncs it
+  journal = nullptr;
+  for(unsigned int i = 0, s = current_jobs.size(); i < s; i++) {
+    if(current_jobs[i] != nullptr) { delete current_jobs[i]; current_jobs[i] = nullptr; } // if
+  } // for
+  if(term_writer != nullptr) {
+    term_writer->drain(TERM_EXIT_DRAIN_MS); // but doesn't wait on a terminal that isn't reading
+    cout.rdbuf(cout_direct);
+  } // if
+  exit(status);
+} // exit_shell
 
 inline void nope_out(const string & sc_name) {
   perror(sc_name.c_str());
   exit(EXIT_FAILURE);
 } // nope_out
 
-void prompt() {
-  char cwd[PATH_MAX];
-  const char * homedir = nullptr;
-  string s_cwd = "";
-  string s_homedir = "";
-  string prompt = "";
-  // home dir stuff
-  if((homedir = getenv("HOME")) == NULL) {
-    homedir = getpwuid(getuid())->pw_dir;
+void watch_busy(const char * phase, const char * detail) {
+  if(watchdog != nullptr) watchdog->busy(phase, current_jobs.size(), detail);
+} // watch_busy
+
+void watch_idle(const char * phase) {
+  if(watchdog != nullptr) watchdog->idle(phase);
+} // watch_idle
+
+bool prompt(string & out) {
+  const char * tmpl = getenv("PROMPT");
+  if(tmpl == nullptr) {
+    // the logical cwd is tracked by cd, so no getcwd() needed here
+    out = "1730sh:" + tilde_path(logical_pwd) + "$ ";
+    return false;
   } // if
-  s_homedir = string(homedir);
-  // current dir stuff
-  if(getcwd(cwd,sizeof(cwd)) == nullptr) { nope_out("getcwd"); } // if
-  s_cwd = string(cwd);
-  // prompt stuff
-  prompt = s_cwd;
-  size_t pos;
-  if((pos = prompt.find(s_homedir)) != string::npos) {
-    prompt.replace(pos,s_homedir.size(),"~");
-  } // if
-  cout << "1730sh:" << prompt << "$ ";
+  out = "";
+  bool pending = false;
+  for(const char * c = tmpl; *c != '\0'; c++) {
+    const char * close = (*c == '{') ? strchr(c, '}') : nullptr;
+    string name = (close != nullptr) ? string(c + 1, close) : "";
+    if(name == "cwd") {
+      out += tilde_path(logical_pwd);
+    } else if(name == "user") {
+      const char * user = getenv("USER");
+      out += (user != nullptr) ? user : "";
+    } else if(name == "host") {
+      char host[HOST_NAME_MAX + 1] = "";
+      gethostname(host, sizeof(host) - 1);
+      out += string(host).substr(0, string(host).find('.'));
+    } else if(PromptSegments::isSegment(name)) {
+      if(prompt_segments == nullptr) prompt_segments = new PromptSegments(environ_list());
+      string value;
+      if(!prompt_segments->get(name, logical_pwd, value)) pending = true;
+      out += value;
+    } else {
+      out += *c;
+      continue;
+    } // if/else
+    c = close;
+  } // for
+  return pending;
 } // prompt
 
+void redraw_prompt(const string & shown, const string & next) {
+  // the number of columns a prompt takes: escape sequences and UTF-8 continuation bytes take none
+  auto width = [](const string & s) {
+    long w = 0;
+    for(unsigned int i = 0; i < s.size(); i++) {
+      if(s[i] == '\033') {
+	while(i + 1 < s.size() && !isalpha(s[i+1])) i++;
+	i++;
+      } else if((s[i] & 0xC0) != 0x80) {
+	w++;
+      } // if/else
+    } // for
+    return w;
+  };
+  long delta = width(next) - width(shown);
+  // save the cursor, make room for (or take back) the difference at the start of the line
+  // by inserting (or deleting) characters, which shifts any typed input along, and write
+  // the new prompt over the old one
+  string out = "\0337\r";
+  if(delta > 0) out += "\033[" + to_string(delta) + "@";
+  if(delta < 0) out += "\033[" + to_string(-delta) + "P";
+  out += next + "\0338";
+  // the cursor went back to its saved column, which the input has moved away from
+  if(delta > 0) out += "\033[" + to_string(delta) + "C";
+  if(delta < 0) out += "\033[" + to_string(-delta) + "D";
+  cout << out << flush;
+} // redraw_prompt
+
+vector<string> environ_list() {
+  vector<string> env;
+  for(char ** e = environ; *e != nullptr; e++) env.push_back(*e);
+  return env;
+} // environ_list
+
 bool isValidInput(string input) {
   if(input.length() == 0) return true;
   bool redirect_in_flag = false;
@@ -524,13 +1998,13 @@ bool isValidInput(string input) {
       } else {
 	return false;
       } // if/else
-    } else if(argv[i] == ">" || argv[i] == ">>") {
+    } else if(redirectOp(argv[i]) == ">" || redirectOp(argv[i]) == ">>") {
       if(!redirect_out_flag) { 
 	redirect_out_flag = true; 
       } else {
 	return false;
       } // if/else
-    } else if(argv[i] == "e>" || argv[i] == "e>>") {
+    } else if(redirectOp(argv[i]) == "e>" || redirectOp(argv[i]) == "e>>") {
       if(!redirect_err_flag) { 
 	redirect_err_flag = true; 
       } else {
@@ -573,9 +2047,60 @@ void dl_cstrvec(vector<char *> & cstrvec) {
   } // for
 } // dl_cstrvec
 
-void nice_exec(vector<string> strargs, int** pipes, int numPipes) {
+string resolve_command(const string & name) {
+  if(name.find('/') != string::npos) return name;
+  const char * path = getenv("PATH");
+  if(path == nullptr) path = "/bin:/usr/bin";
+  stringstream ss(path);
+  string dir;
+  struct stat sb;
+  while(getline(ss, dir, ':')) {
+    string candidate = ((dir == "") ? "." : dir) + "/" + name;
+    if(stat(candidate.c_str(), &sb) == 0 && S_ISREG(sb.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    } // if
+  } // while
+  return "";
+} // resolve_command
+
+void readahead_commands(const vector<string> & paths) {
+  if(!shell_options["readahead"]) return;
+  for(unsigned int i = 0; i < paths.size(); i++) {
+    if(paths[i] != "") readahead_exec(paths[i], shell_options["readahead-libs"]);
+  } // for
+} // readahead_commands
+
+vector<string> command_names(vector<string> tokens) {
+  expandAliases(tokens);
+  vector<string> names;
+  bool cmdPos = true;
+  for(unsigned int i = 0; i < tokens.size(); i++) {
+    if(cmdPos && tokens[i] != "|") names.push_back(unmark(tokens[i]));
+    cmdPos = (tokens[i] == "|");
+  } // for
+  return names;
+} // command_names
+
+vector<string> suggest_commands(const string & name) {
+  if(command_index == nullptr) {
+    command_index = new CommandIndex();
+    for(auto it = builtins.begin(); it != builtins.end(); ++it) command_index->add(it->first);
+  } // if
+  const char * path = getenv("PATH");
+  command_index->refresh((path != nullptr) ? path : "/bin:/usr/bin");
+  // one edit for short names, where two would suggest nearly anything
+  vector<string> found = command_index->suggest(name, (name.size() <= 4) ? 1 : 2);
+  vector<string> suggestions;
+  for(unsigned int i = 0; i < found.size() && suggestions.size() < 3; i++) {
+    if(builtins.count(found[i]) != 0 || resolve_command(found[i]) != "") suggestions.push_back(found[i]);
+  } // for
+  return suggestions;
+} // suggest_commands
+
+void nice_exec(vector<string> strargs, int** pipes, int numPipes, const string & resolved) {
   vector<char *> cstrargs = mk_cstrvec(strargs);
-  execvp(cstrargs.at(0), &cstrargs.at(0));
+  if(resolved != "") execv(resolved.c_str(), &cstrargs.at(0));
+  execvp(cstrargs.at(0), &cstrargs.at(0)); // e.g., for scripts without a #! line
   // only makes it here if execvp fails
   cout << "1730sh: " << cstrargs.at(0) << ": command not found" << endl;
   // close pipes
@@ -621,46 +2146,180 @@ void close_pipe(int pipefd[2], bool exit_on_failure) {
   } // if
 } // close_pipe
 
+void do_shell_redirects(int STDIN, int STDOUT, int STDERR, int saved[3]) {
+  int fds[3] = {STDIN, STDOUT, STDERR};
+  cout.flush(); // anything already written belongs to the old stdout
+  for(int i = 0; i < 3; i++) {
+    saved[i] = -1;
+    if(fds[i] < 0 || fds[i] == i) continue;
+    if((saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10)) == -1) nope_out("fcntl");
+    if(dup2(fds[i], i) == -1) nope_out("dup2");
+  } // for
+  // term_writer only writes to the terminal
+  if(saved[STDOUT_FILENO] != -1 && term_writer != nullptr && cout.rdbuf() == term_writer) cout.rdbuf(cout_direct);
+} // do_shell_redirects
+
+void restore_redirects(int saved[3]) {
+  cout.flush();
+  cerr.flush();
+  for(int i = 0; i < 3; i++) {
+    if(saved[i] == -1) continue;
+    if(dup2(saved[i], i) == -1) nope_out("dup2");
+    close(saved[i]);
+  } // for
+  if(saved[STDOUT_FILENO] != -1 && term_writer != nullptr && cout.rdbuf() == cout_direct) cout.rdbuf(term_writer);
+} // restore_redirects
+
 int set_redirects(Input * job, int& fdSTDIN, int& fdSTDOUT, int& fdSTDERR) {
   fdSTDIN = STDIN_FILENO;
   fdSTDOUT = STDOUT_FILENO;
   fdSTDERR = STDERR_FILENO;
+  // relay modifiers are checked first, so that a bad one doesn't truncate the file
+  bool stdoutRelay = job->getSTDOUT_type().find_first_of("#@") != string::npos;
+  bool stderrRelay = job->getSTDERR_type().find_first_of("#@") != string::npos;
+  RelayFilter * outFilter = (stdoutRelay) ? make_relay_filter(job->getSTDOUT_type()) : nullptr;
+  RelayFilter * errFilter = (stderrRelay) ? make_relay_filter(job->getSTDERR_type()) : nullptr;
+  // closes whatever was opened (ending a stdout relay already started), for an error return
+  auto fail = [&]() {
+    if(fdSTDIN > STDIN_FILENO) close(fdSTDIN);
+    if(fdSTDOUT > STDERR_FILENO) close(fdSTDOUT);
+    if(fdSTDERR > STDERR_FILENO) close(fdSTDERR);
+    fdSTDIN = STDIN_FILENO;
+    fdSTDOUT = STDOUT_FILENO;
+    fdSTDERR = STDERR_FILENO;
+    delete outFilter;
+    delete errFilter;
+    return -1;
+  };
+  if((stdoutRelay && outFilter == nullptr) || (stderrRelay && errFilter == nullptr)) return fail();
   // if user input specified any i/o redirection, open/create the given fd's
   if(job->getSTDIN_fd() != "STDIN_FILENO") {
-    if((fdSTDIN = open(job->getSTDIN_fd().c_str(), O_RDONLY)) == -1) {
+    if((fdSTDIN = open(job->getSTDIN_fd().c_str(), O_RDONLY | O_CLOEXEC)) == -1) {
       cout << "1730sh: " << job->getSTDIN_fd() << ": No such file or directory" << endl;
-      return -1;
+      return fail();
     } // if
   } // if
-  if(job->getSTDOUT_fd() != "STDOUT_FILENO") {
-    if(job->getSTDOUT_type() == ">") {
-      if((fdSTDOUT = open(job->getSTDOUT_fd().c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644)) == -1) {
-	cout << "1730sh: `" << job->getSTDOUT_fd() << "' cannot be opened" << endl;
-	return -1;
-      } // if
-    } else {
-      if((fdSTDOUT = open(job->getSTDOUT_fd().c_str(), O_CREAT | O_WRONLY | O_APPEND, 0666)) == -1) {
-	cout << "1730sh: `" << job->getSTDOUT_fd() << "' cannot be opened" << endl;
-	return -1;
-      } // if
-    } // if/else
+  // relay redirects to '-' write to the shell's own stdout/stderr (e.g., the terminal)
+  if(stdoutRelay && job->getSTDOUT_fd() == "-") {
+    if((fdSTDOUT = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3)) == -1) nope_out("dup");
+  } else if(job->getSTDOUT_fd() != "STDOUT_FILENO") {
+    int flags = (redirectOp(job->getSTDOUT_type()) == ">") ? O_TRUNC : O_APPEND;
+    if((fdSTDOUT = open(job->getSTDOUT_fd().c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | flags, (flags == O_TRUNC) ? 0644 : 0666)) == -1) {
+      cout << "1730sh: `" << job->getSTDOUT_fd() << "' cannot be opened" << endl;
+      return fail();
+    } // if
   } // if
-  if(job->getSTDERR_fd() != "STDERR_FILENO") {
-    if(job->getSTDERR_type() == "e>") {
-      if((fdSTDERR = open(job->getSTDERR_fd().c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644)) == -1) {
-	cout << "1730sh: `" << job->getSTDERR_fd() << "' cannot be opened" << endl;
-	return -1;
-      } // if
-    } else {
-      if((fdSTDERR = open(job->getSTDERR_fd().c_str(), O_CREAT | O_WRONLY | O_APPEND, 0666)) == -1) {
-	cout << "1730sh: `" << job->getSTDERR_fd() << "' cannot be opened" << endl;
-	return -1;
-      } // if
-    } // if/else
+  if(stderrRelay && job->getSTDERR_fd() == "-") {
+    if((fdSTDERR = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3)) == -1) nope_out("dup");
+  } else if(job->getSTDERR_fd() != "STDERR_FILENO") {
+    int flags = (redirectOp(job->getSTDERR_type()) == "e>") ? O_TRUNC : O_APPEND;
+    if((fdSTDERR = open(job->getSTDERR_fd().c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | flags, (flags == O_TRUNC) ? 0644 : 0666)) == -1) {
+      cout << "1730sh: `" << job->getSTDERR_fd() << "' cannot be opened" << endl;
+      return fail();
+    } // if
+  } // if
+  // checksum and timestamp modifiers (e.g., '>#sha256', '>@mono') put a relay in front of the file
+  if(stdoutRelay) {
+    RelayFilter * filter = outFilter;
+    outFilter = nullptr; // the relay's now, even if it fails
+    if(open_relay_redirect(job, job->getSTDOUT_type(), job->getSTDOUT_fd(), filter, fdSTDOUT) == -1) return fail();
+  } // if
+  if(stderrRelay) {
+    RelayFilter * filter = errFilter;
+    errFilter = nullptr;
+    if(open_relay_redirect(job, job->getSTDERR_type(), job->getSTDERR_fd(), filter, fdSTDERR) == -1) return fail();
   } // if
   return 0;
 } // set_redirects
 
+RelayFilter * make_relay_filter(const string & type) {
+  size_t mod = type.find_first_of("#@");
+  string spec = type.substr(mod + 1); // ALG[=VAR] or CLOCK
+  RelayFilter * filter;
+  if(type[mod] == '#') {
+    string alg = spec.substr(0, spec.find('='));
+    if((filter = Digest::create(alg)) == nullptr) {
+      cout << "1730sh: " << alg << ": unknown checksum (crc32c, sha256 or xxh64)" << endl;
+    } // if
+  } else {
+    if((filter = Timestamp::create(spec)) == nullptr) {
+      cout << "1730sh: " << spec << ": unknown clock (wall, mono or delta)" << endl;
+    } // if
+  } // if/else
+  return filter;
+} // make_relay_filter
+
+int open_relay_redirect(Input * job, const string & type, const string & file, RelayFilter * filter, int & fd) {
+  size_t eq = type.find('=');
+  Digest * digest = dynamic_cast<Digest *>(filter);
+  int fds[2];
+  if(pipe2(fds, O_CLOEXEC) == -1) {
+    cout << "1730sh: pipe: " << strerror(errno) << endl;
+    delete filter;
+    return -1;
+  } // if
+  fcntl(fd, F_SETFD, FD_CLOEXEC); // only the relay writes the file now
+  OutputRelay * relay = new OutputRelay();
+  relay->job = job;
+  relay->filter = filter;
+  relay->digest = digest;
+  relay->file = file;
+  relay->var = (digest != nullptr && eq != string::npos) ? type.substr(eq + 1) : "";
+  int in = fds[0], out = fd;
+  // signals are the main thread's to handle
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  relay->worker = thread([relay, in, out]() {
+      RelayEngine * engine = RelayEngine::create();
+      RelayStats stats;
+      if(engine->relay(in, {out}, relay->filter, stats) == -1) relay->error = errno;
+      delete engine;
+      close(in);
+      close(out);
+      lock_guard<mutex> lock(relay->lock);
+      relay->done = true;
+      relay->finished.notify_all();
+    });
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  output_relays.push_back(relay);
+  fd = fds[1];
+  return 0;
+} // open_relay_redirect
+
+void finish_output_relays(Input * job) {
+  for(unsigned int i = 0; i < output_relays.size(); ) {
+    OutputRelay * relay = output_relays[i];
+    if(relay->job != job) {
+      i++;
+      continue;
+    } // if
+    {
+      unique_lock<mutex> lock(relay->lock);
+      // done once every writer has closed the pipe
+      if(!relay->finished.wait_for(lock, chrono::milliseconds((job != nullptr) ? RELAY_WAIT_MS : 0),
+				   [relay]() { return relay->done; })) {
+	relay->job = nullptr; // the job is about to be deleted
+	i++;
+	continue;
+      } // if
+    }
+    relay->worker.join();
+    if(relay->error != 0) {
+      cout << "1730sh: " << relay->file << ": " << strerror(relay->error) << endl;
+    } else if(relay->digest != nullptr && relay->var != "") {
+      setenv(relay->var.c_str(), relay->digest->hex().c_str(), 1);
+    } else if(relay->digest != nullptr) {
+      ofstream sidecar(relay->file + "." + relay->digest->name());
+      sidecar << relay->digest->hex() << "  " << relay->file << endl;
+      if(!sidecar) cout << "1730sh: " << relay->file << "." << relay->digest->name() << ": cannot be written" << endl;
+    } // if/else
+    delete relay->filter;
+    delete relay;
+    output_relays.erase(output_relays.begin() + i);
+  } // for
+} // finish_output_relays
+
 void do_redirects(int STDIN, int STDOUT, int STDERR) {
   if(STDIN >= 0) {
     if(dup2(STDIN, STDIN_FILENO) == -1) nope_out("dup2");
@@ -714,16 +2373,23 @@ void wait_for_job(Input * job) {
   if(job != nullptr) {
     int wpid, pstatus;
     if((wpid = waitpid(job->getProcesses().back().PID, &pstatus, WUNTRACED)) > 0) {
+      if(shell_options["subreaper"] && (WIFEXITED(pstatus) || WIFSIGNALED(pstatus))) {
+	track_descendants(job); // while the job can still be credited with its orphans
+      } // if
       if(WIFEXITED(pstatus)) {
-	cout << job->getJID() << " " 
-	     << "Exited (" << WEXITSTATUS(pstatus) << ")" << " " 
-	     << job->getShellInput() << endl;
+	if(report_jobs) {
+	  cout << job->getJID() << " " 
+	       << "Exited (" << WEXITSTATUS(pstatus) << ")" << " " 
+	       << job->getShellInput() << endl;
+	} // if
 	delete_from_current_jobs(job);	
 	last_exit_status = WEXITSTATUS(pstatus);
       } else if(WIFSIGNALED(pstatus)) {
-	cout << job->getJID() << " " 
-	     << "Exited (" << strsignal(WTERMSIG(pstatus)) << ")" << " " 
-	     << job->getShellInput() << endl;
+	if(report_jobs) {
+	  cout << job->getJID() << " " 
+	       << "Exited (" << strsignal(WTERMSIG(pstatus)) << ")" << " " 
+	       << job->getShellInput() << endl;
+	} // if
 	delete_from_current_jobs(job);
 	last_exit_status = WTERMSIG(pstatus);
       } else if(WIFSTOPPED(pstatus)) {
@@ -740,7 +2406,9 @@ void wait_for_job(Input * job) {
 void put_job_in_foreground(Input * job, bool cont) {
   if(job != nullptr) {
     // makes JID the foreground pgrp of the terminal
-    if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } 
+    if(job_control) {
+      if(tcsetpgrp(shell_terminal, job->getJID()) == -1) { nope_out("tcsetpgrp"); } 
+    } // if
     // Send the job a continue signal, if necessary
     if(cont) {
       if(kill(-job->getJID(), SIGCONT) < 0) {
@@ -748,9 +2416,13 @@ void put_job_in_foreground(Input * job, bool cont) {
       } // if
     } // if
     // wait for job to finish
+    watch_idle("foreground job");
     wait_for_job(job); 
+    watch_busy("foreground job done");
     // makes the shell the foreground pgrp again
-    if(tcsetpgrp(shell_terminal, shell_pgid) == -1) { nope_out("tcsetpgrp"); }
+    if(job_control) {
+      if(tcsetpgrp(shell_terminal, shell_pgid) == -1) { nope_out("tcsetpgrp"); }
+    } // if
   } // if
 } // put_job_in_foreground
 
@@ -767,40 +2439,197 @@ void put_job_in_background(Input * job, bool cont) {
 void check_current_jobs() {
   pid_t wpid;
   int pstatus;
+  string notes;
+  vector<string> exits;
+  size_t failed = 0;
+  if(shell_options["subreaper"]) {
+    track_descendants(); // before any job is deleted, so its descendants can still be attributed
+    reap_orphans();
+  } // if
   for(unsigned int i = 0, s = current_jobs.size(); i < s; i++) {
     if(current_jobs[i] != nullptr) {
       pid_t pid = current_jobs[i]->getProcesses().back().PID;
+      string prefix = to_string(current_jobs[i]->getJID()) + " ";
       while((wpid = waitpid(pid, &pstatus, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
 	if(WIFEXITED(pstatus)) {
-	  cout << current_jobs[i]->getJID() << " "
-	       << "Exited (" << WEXITSTATUS(pstatus) << ")" << " " 
-	       << current_jobs[i]->getShellInput() << endl;
+	  exits.push_back(prefix + "Exited (" + to_string(WEXITSTATUS(pstatus)) + ") " +
+			  current_jobs[i]->getShellInput());
+	  if(WEXITSTATUS(pstatus) != 0) failed++;
 	  last_exit_status = WEXITSTATUS(pstatus);
 	  delete_from_current_jobs(current_jobs[i]);
 	  break;
 	} else if(WIFSIGNALED(pstatus)) {
-	  cout << current_jobs[i]->getJID() << " "
-	       << "Exited (" << strsignal(WTERMSIG(pstatus)) << ")" << " " 
-	       << current_jobs[i]->getShellInput() << endl;
+	  exits.push_back(prefix + "Exited (" + strsignal(WTERMSIG(pstatus)) + ") " +
+			  current_jobs[i]->getShellInput());
+	  failed++;
 	  last_exit_status = WTERMSIG(pstatus);
 	  delete_from_current_jobs(current_jobs[i]);
 	  break;
 	} else if(WIFSTOPPED(pstatus)) {
 	  current_jobs[i]->setStatus("Stopped");
-	  format_job_info(current_jobs[i],"Stopped");
+	  notes += prefix + "Stopped " + current_jobs[i]->getShellInput() + "\n";
 	  break;
 	} else if(WIFCONTINUED(pstatus)) {
 	  current_jobs[i]->setStatus("Running");
-	  format_job_info(current_jobs[i],"Continued");
+	  notes += prefix + "Continued " + current_jobs[i]->getShellInput() + "\n";
 	  break;
 	} // if/else	
       } // while
     } // if
   } // for
-} // check_current_jobs
+  finish_output_relays(nullptr); // relays detached from jobs that have since finished
+  print_notifications(notes, exits, failed);
+} // check_current_jobs
+
+void print_notifications(string & notes, const vector<string> & exits, size_t failed) {
+  const char * env = getenv("NOTIFY_LIMIT");
+  size_t limit = (env != nullptr && isdigit(env[0])) ? strtoul(env, nullptr, 10) : NOTIFY_LIMIT;
+  if(exits.size() <= limit) {
+    for(unsigned int i = 0; i < exits.size(); i++) notes += exits[i] + "\n";
+  } else {
+    notes += with_commas(exits.size()) + " jobs exited (" + with_commas(exits.size() - failed) + " ok, " +
+      with_commas(failed) + " failed; see jobs -x)\n";
+    exited_log.insert(exited_log.end(), exits.begin(), exits.end());
+    while(exited_log.size() > EXITED_LOG_MAX) exited_log.pop_front();
+  } // if/else
+  // one write, however many jobs were reaped, so a slow terminal isn't hit line by line
+  if(notes != "") cout << notes << flush;
+} // print_notifications
+
+string with_commas(size_t n) {
+  string digits = to_string(n);
+  for(int i = (int) digits.size() - 3; i > 0; i -= 3) digits.insert(i, ",");
+  return digits;
+} // with_commas
+
+void track_descendants(Input * finished) {
+  struct ProcInfo {
+    pid_t ppid;
+    pid_t pgrp;
+    string comm;
+  }; // ProcInfo
+  auto read_stat = [](pid_t pid, ProcInfo & info) {
+    ifstream in("/proc/" + to_string(pid) + "/stat");
+    string stat;
+    if(!getline(in, stat)) return false;
+    // pid (comm) state ppid pgrp ...  where comm may itself contain ')'
+    size_t open = stat.find('('), close = stat.rfind(')');
+    if(open == string::npos || close == string::npos) return false;
+    char state;
+    info.comm = stat.substr(open + 1, close - open - 1);
+    return sscanf(stat.c_str() + close + 1, " %c %d %d", &state, &info.ppid, &info.pgrp) == 3;
+  };
+  // adds the children of every thread of pid to found. false if the kernel doesn't list them
+  auto read_children = [](pid_t pid, vector<pid_t> & found) {
+    string dir = "/proc/" + to_string(pid) + "/task";
+    DIR * tasks = opendir(dir.c_str());
+    if(tasks == nullptr) return false;
+    bool listed = false;
+    struct dirent * entry;
+    while((entry = readdir(tasks)) != nullptr) {
+      if(entry->d_name[0] == '.') continue;
+      ifstream in(dir + "/" + entry->d_name + "/children");
+      if(!in) continue;
+      listed = true;
+      pid_t child;
+      while(in >> child) found.push_back(child);
+    } // while
+    closedir(tasks);
+    return listed;
+  };
+  map<pid_t, ProcInfo> procs;
+  pid_t self = getpid();
+  vector<pid_t> todo;
+  if(read_children(self, todo)) {
+    // walks down from the shell, so a pass costs O(descendants), not O(host processes).
+    // as a subreaper, the shell inherits every orphan below it, so none is missed
+    while(!todo.empty()) {
+      pid_t pid = todo.back();
+      todo.pop_back();
+      ProcInfo info;
+      if(procs.count(pid) != 0 || !read_stat(pid, info)) continue;
+      procs[pid] = info;
+      read_children(pid, todo);
+    } // while
+  } else { // without /proc/PID/task/TID/children, every process has to be looked at
+    static struct timespec last = {0, 0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t since = (now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000;
+    if(last.tv_sec != 0 && since < TRACK_SCAN_MS) return; // so not on every prompt
+    last = now;
+    DIR * proc = opendir("/proc");
+    if(proc == nullptr) return;
+    struct dirent * entry;
+    while((entry = readdir(proc)) != nullptr) {
+      pid_t pid = atoi(entry->d_name);
+      ProcInfo info;
+      if(pid > 0 && read_stat(pid, info)) procs[pid] = info;
+    } // while
+    closedir(proc);
+  } // if/else
+  // a job's own processes are reaped by check_current_jobs(), never here
+  map<pid_t, Input*> jobs, members;
+  for(unsigned int i = 0; i < current_jobs.size(); i++) {
+    if(current_jobs[i] == nullptr) continue;
+    jobs[current_jobs[i]->getJID()] = current_jobs[i];
+    for(const Process & p : current_jobs[i]->getProcesses()) members[p.PID] = current_jobs[i];
+  } // for
+  // descendants that exited before being orphaned were reaped by their parents
+  for(auto it = descendants.begin(); it != descendants.end(); ) {
+    it = (it->second.reaped || procs.count(it->first) != 0) ? next(it) : descendants.erase(it);
+  } // for
+  bool only_job = (finished != nullptr && jobs.size() == 1 && jobs.count(finished->getJID()) != 0);
+  for(auto it = procs.begin(); it != procs.end(); ++it) {
+    pid_t pid = it->first;
+    if(pid == self || members.count(pid) != 0) continue;
+    if(prompt_segments != nullptr && prompt_segments->owns(pid)) continue; // reaped by its thread
+    auto known = descendants.find(pid);
+    if(known == descendants.end()) {
+      Descendant d;
+      if(jobs.count(it->second.pgrp) != 0) { // still in the job's process group
+	d.jid = it->second.pgrp;
+	d.job = jobs[d.jid]->getShellInput();
+      } else { // walk up the parents to a job process or a known descendant
+	pid_t up = it->second.ppid;
+	for(int depth = 0; depth < 64 && up > 1 && up != self; depth++) {
+	  if(members.count(up) != 0) {
+	    d.jid = members[up]->getJID();
+	    d.job = members[up]->getShellInput();
+	    break;
+	  } // if
+	  if(descendants.count(up) != 0) {
+	    d.jid = descendants[up].jid;
+	    d.job = descendants[up].job;
+	    break;
+	  } // if
+	  if(procs.count(up) == 0) break;
+	  up = procs[up].ppid;
+	} // for
+	if(d.jid == 0 && it->second.ppid != self) continue; // not ours
+	if(d.jid == 0 && only_job) {
+	  d.jid = finished->getJID();
+	  d.job = finished->getShellInput();
+	} // if
+      } // if/else
+      d.comm = it->second.comm;
+      known = descendants.emplace(pid, d).first;
+    } // if
+    if(it->second.ppid == self) known->second.orphaned = true;
+  } // for
+} // track_descendants
+
+void reap_orphans() {
+  for(auto it = descendants.begin(); it != descendants.end(); ++it) {
+    Descendant & d = it->second;
+    if(!d.orphaned || d.reaped) continue;
+    if(wait4(it->first, &d.status, WNOHANG, &d.usage) == it->first) d.reaped = true;
+  } // for
+} // reap_orphans
 
 void delete_from_current_jobs(Input * job) {
   if(job != nullptr) {
+    finish_output_relays(job);
     for(unsigned int i = 0, s = current_jobs.size(); i < s; i++) {
       if(current_jobs[i] != nullptr) {
 	if(job->getJID() == current_jobs[i]->getJID()) { 
@@ -826,8 +2655,117 @@ void chdir_home() {
   } // if
   s_homedir = string(homedir);
   chdir(homedir);
+  logical_pwd = lexical_path(s_homedir);
+  setenv("PWD", logical_pwd.c_str(), 1);
 } // chdir_home
 
+string home_path(const string & name) {
+  const char * homedir = nullptr;
+  if((homedir = getenv("HOME")) == nullptr) {
+    homedir = getpwuid(getuid())->pw_dir;
+  } // if
+  return string(homedir) + "/" + name;
+} // home_path
+
+string lexical_path(const string & path) {
+  vector<string> parts;
+  stringstream ss(path);
+  string part;
+  while(getline(ss, part, '/')) {
+    if(part == "" || part == ".") {
+      continue;
+    } else if(part == "..") {
+      if(!parts.empty()) parts.pop_back();
+    } else {
+      parts.push_back(part);
+    } // if/else
+  } // while
+  string resolved = "";
+  for(unsigned int i = 0; i < parts.size(); i++) {
+    resolved += "/" + parts[i];
+  } // for
+  return (resolved == "") ? "/" : resolved;
+} // lexical_path
+
+string tilde_path(const string & path) {
+  const char * homedir = nullptr;
+  if((homedir = getenv("HOME")) == nullptr) {
+    homedir = getpwuid(getuid())->pw_dir;
+  } // if
+  string s_homedir = lexical_path(string(homedir));
+  if(s_homedir == "/") return path;
+  if(path.compare(0, s_homedir.size(), s_homedir) == 0 &&
+     (path.size() == s_homedir.size() || path[s_homedir.size()] == '/')) {
+    return "~" + path.substr(s_homedir.size());
+  } // if
+  return path;
+} // tilde_path
+
+bool is_dir_cached(const string & path) {
+  time_t now = time(nullptr);
+  auto it = cdpath_cache->find(path);
+  if(it != cdpath_cache->end()) {
+    if(it->second.isDir || now - it->second.checked < CDPATH_NEG_TTL) {
+      return it->second.isDir;
+    } // if
+  } // if
+  struct stat sb;
+  bool isDir = (stat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode));
+  if(it != cdpath_cache->end()) {
+    it->second = DirCacheEntry{isDir, now};
+  } else {
+    cdpath_cache->emplace(arena_string(path.begin(), path.end()), DirCacheEntry{isDir, now});
+  } // if/else
+  return isDir;
+} // is_dir_cached
+
+int change_dir(const string & dest, bool print, const string & name) {
+  string target = "";
+  bool fromCache = false;
+  if(dest[0] == '/') { // absolute path
+    target = lexical_path(dest);
+  } else {
+    // CDPATH is only searched for paths that don't explicitly start with '.' or '..'
+    const char * cdpath = getenv("CDPATH");
+    bool explicitRel = (dest == "." || dest == ".." || dest.compare(0,2,"./") == 0 || dest.compare(0,3,"../") == 0);
+    if(cdpath != nullptr && !explicitRel) {
+      stringstream ss(cdpath);
+      string entry;
+      while(getline(ss, entry, ':')) {
+	string base = (entry == "") ? logical_pwd : ((entry[0] == '/') ? entry : logical_pwd + "/" + entry);
+	string candidate = lexical_path(base + "/" + dest);
+	if(is_dir_cached(candidate)) {
+	  target = candidate;
+	  fromCache = true;
+	  if(entry != "" && entry != ".") print = true; // found via CDPATH, so tell the user where
+	  break;
+	} // if
+      } // while
+    } // if
+    if(target == "") target = lexical_path(logical_pwd + "/" + dest);
+  } // if/else
+  if(chdir(target.c_str()) == -1) {
+    int err = errno;
+    if(fromCache) {
+      auto it = cdpath_cache->find(target);
+      if(it != cdpath_cache->end()) cdpath_cache->erase(it);
+    } // if
+    // the lexical path may not exist if '..' followed a symlink, so fall back to the physical one
+    char cwd[PATH_MAX];
+    if(dest[0] == '/' || chdir(dest.c_str()) == -1 || getcwd(cwd,sizeof(cwd)) == nullptr) {
+      cout << "1730sh: " << name << ": " << dest << ": " << strerror(err) << endl;
+      return -1;
+    } // if
+    target = string(cwd);
+  } // if
+  setenv("OLDPWD", logical_pwd.c_str(), 1);
+  logical_pwd = target;
+  setenv("PWD", logical_pwd.c_str(), 1);
+  if(print) cout << logical_pwd << endl;
+  frecency->record(logical_pwd);
+  return 0;
+} // change_dir
+
 void print_logo() {
   cout << ":  ....,.......,..,...  ..,,,.,:::~::::::::+~=~:,,., ..,,.,.,:,,,.,,..........+Z" << endl;
   cout << "....... ...,,..,...........,~OOOO88N$$$ZO$$$$$$7=,...........~:,,...,.........,Z" << endl;
@@ -887,52 +2825,24 @@ void print_logo() {
 // BUILT-IN STUFF
 
 bool isBuiltIn(string & command) {
-  bool isBuiltIn = false;
-  if(command == "cd") {
-    isBuiltIn = true;
-  } else if(command == "exit") {
-    isBuiltIn = true;
-  } else if(command == "help") {
-    isBuiltIn = true;
-  } else if(command == "bg") {
-    isBuiltIn = true;
-  } else if(command == "fg") {
-    isBuiltIn = true;
-  } else if(command == "export") {
-    isBuiltIn = true;
-  } else if(command == "jobs") {
-    isBuiltIn = true;
-  } else if(command == "kill") {
-    isBuiltIn = true;
-  } // if/else
-  return isBuiltIn;
+  return builtins.count(command) != 0;
 } // isBuiltIn
 
 void callBuiltIn(string & command, const vector<string>& args, Input * job) {
-  if(command == "cd") { // changes current working dir
-    last_exit_status = (cd_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "exit") { // exits shell with specified status
+  if(command == "exit") { // exits shell with specified status
     int status;
     last_exit_status = ((status = exit_builtin(args)) != -1) ? status : EXIT_FAILURE;
-    delete job;
     if(status != -1) {
-      for(unsigned int i = 0, s = current_jobs.size(); i < s; i++) {
-	if(current_jobs[i] != nullptr) delete current_jobs[i]; current_jobs[i] = nullptr;
-      } // for
-      exit(status);
+      delete job;
+      exit_shell(status);
     } // if
-  } else if(command == "help") { // prints built-in command options
-    last_exit_status = (help_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "bg") { // puts and resumes job in background
-    last_exit_status = (bg_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "fg") { // puts and resumes job in foreground
-    last_exit_status = (fg_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "export") { // changes env variables
-    last_exit_status = (export_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "jobs") { // prints status of currently running jobs
-    last_exit_status = (jobs_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
-  } else if(command == "kill") { // sends specified signal to specified pid/pgid
-    last_exit_status = (kill_builtin(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
+  } else {
+    auto builtin = builtins.find(command);
+    // waiting on purpose isn't a stall
+    if(command == "sleep" || command == "read") watch_idle(builtin->first.c_str());
+    else watch_busy("builtin", builtin->first.c_str());
+    last_exit_status = (builtin->second(args) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
+    watch_busy("run_line");
   } // if/else
   delete job;
 } // callBuiltIn
@@ -982,19 +2892,46 @@ int help_builtin(const vector<string> & args) {
   } else {
     cout << "Here are some useful commands to make navigating the shell a bit easier:" << endl;
     cout << endl;
+    cout << ": [ARG ...] – Do nothing, successfully (same as true)." << endl;
+    cout << endl;
+    cout << "alias [NAME[=VALUE] ...] – Define NAME as an alias for VALUE, or print the alias NAME. With no args, print every" << endl;
+    cout << "alias. When NAME is the first word of a command (or follows a pipe), it is replaced by VALUE." << endl;
+    cout << endl;
+    cout << "basename NAME [SUFFIX] – Print NAME with any leading directory components removed. If SUFFIX is given and" << endl;
+    cout << "NAME ends with it, remove it too." << endl;
+    cout << endl;
     cout << "bg JID – Resume the stopped job JID in the background, as if it had been started with &." << endl;
     cout << endl;
-    cout << "cd [PATH] – Change the current directory to PATH. The environmental variable HOME is the default PATH." << endl;
+    cout << "cd [PATH | -] – Change the current directory to PATH. The environmental variable HOME is the default PATH." << endl;
+    cout << "If PATH is -, change to the previous directory ($OLDPWD). Relative paths are searched for in the colon-separated" << endl;
+    cout << "list of directories in CDPATH (if set) before the current directory. '..' is resolved logically (against $PWD)." << endl;
+    cout << endl;
+    cout << "dirname NAME – Print NAME with its last component removed, or '.' if NAME has no slashes." << endl;
+    cout << endl;
+    cout << "dirs [-c] – Print the directory stack, beginning with the current directory. With -c, clear the stack." << endl;
+    cout << endl;
+    cout << "echo [-n] [ARG ...] – Print the ARGs, separated by spaces and followed by a newline (unless -n is given)." << endl;
+    cout << endl;
+    cout << "enqueue [-d SPOOLDIR] COMMAND [ARG ...] – Queue COMMAND in the spool directory SPOOLDIR ($SPOOL, or" << endl;
+    cout << "~/.1730sh_spool by default), to be run later by '1730sh --drain SPOOLDIR -j N', which runs up to N queued" << endl;
+    cout << "commands at a time and logs their exit statuses in SPOOLDIR/log. The args are joined with spaces into the" << endl;
+    cout << "command line, so quote a pipeline or redirect for the drainer to run it (e.g., enqueue \"make > log\")." << endl;
     cout << endl;
     cout << "exit [N] – Cause the shell to exit with a status of N. If N is omitted, the exit status is that of the last job executed." << endl;
     cout << endl;
     cout << "export NAME[=WORD] – the variable NAME is automatically included in the environment of subsequently executed jobs." << endl;
     cout << endl;
+    cout << "false – Do nothing, unsuccessfully." << endl;
+    cout << endl;
     cout << "fg JID – Resume job JID in the foreground, and make it the current job." << endl;
     cout << endl;
     cout << "help – Display helpful information about builtin commands." << endl;
     cout << endl;
-    cout << "jobs – List current jobs. Here is an example of the desired output:" << endl;
+    cout << "jobs [-a | -x] – List current jobs. With -a, list the descendants of jobs tracked while the shell is a subreaper" << endl;
+    cout << "(set -o subreaper): their PIDs, the jobs they came from, and, once they exit, their status and CPU time. When" << endl;
+    cout << "more than $NOTIFY_LIMIT (default 10) jobs finish at once, their notifications are summarized in one line. With" << endl;
+    cout << "-x, list the jobs left out of those summaries." << endl;
+    cout << "Here is an example of the desired output of jobs:" << endl;
     cout << endl;
     cout << "          "; cout << "JID  STATUS      COMMAND" << endl;
     cout << "          "; cout << "1137 Stopped     less &" << endl;
@@ -1011,6 +2948,49 @@ int help_builtin(const vector<string> & args) {
     cout << "used, instead of sending SIGTERM, the specified signal is sent instead. SIGNAL can be provided as a signal number" << endl;
     cout << "or a constant (e.g., SIGTERM)." << endl;
     cout << endl;
+    cout << "popd – Remove the top directory from the directory stack and change to it." << endl;
+    cout << endl;
+    cout << "printenv [NAME ...] – Print the value of each environment variable NAME, or all of them as NAME=VALUE." << endl;
+    cout << endl;
+    cout << "printf FORMAT [ARG ...] – Print the ARGs according to FORMAT, as printf(1) does. FORMAT is reused until every" << endl;
+    cout << "ARG has been printed." << endl;
+    cout << endl;
+    cout << "profile [start [HZ] | stop | dump] – Sample the shell's own stacks HZ (default 997) times per second of CPU" << endl;
+    cout << "time it uses, to see where the shell itself (not its jobs) spends its time. 'dump' prints the samples as folded" << endl;
+    cout << "stacks, for flame graph tools. With no args, print whether sampling is running and how many samples were taken." << endl;
+    cout << endl;
+    cout << "pushd [DIR] – Push the current directory onto the directory stack and change to DIR. With no DIR, swap" << endl;
+    cout << "the current directory with the top of the stack." << endl;
+    cout << endl;
+    cout << "pwd [-L | -P] – Print the current directory. With -P, print the physical directory with all symlinks resolved." << endl;
+    cout << endl;
+    cout << "read [NAME ...] – Read a line from stdin and split it on whitespace into the variables NAME, the last one getting" << endl;
+    cout << "the rest of the line (REPLY if no NAME is given). Fails at end of input." << endl;
+    cout << endl;
+    cout << "set [-o | +o] [OPTION] – Enable (-o) or disable (+o) the shell option OPTION. With no OPTION, print every option." << endl;
+    cout << "Options: lastpipe – run a builtin at the end of a foreground pipeline in the shell itself, so that e.g." << endl;
+    cout << "'CMD | read X' keeps X (on by default; only without job control, e.g. in scripts). pipeopt – rewrite 'cat FILE | CMD' as 'CMD < FILE' and drop 'cat'/'tee" << endl;
+    cout << "/dev/null' stages that only copy their input, reporting each rewrite on stderr. readahead – read programs into" << endl;
+    cout << "the page cache before running them (on by default); readahead-libs – also their shared libraries. subreaper –" << endl;
+    cout << "adopt descendants that daemonize (double-fork) and escape their job, reap them when they exit, and list them" << endl;
+    cout << "with 'jobs -a'." << endl;
+    cout << endl;
+    cout << "sleep NUMBER[s|m|h|d] ... – Wait for the total of the given durations (seconds by default). Job" << endl;
+    cout << "notifications are still printed while waiting, and ^C stops the wait." << endl;
+    cout << endl;
+    cout << "stalls [-c] – List the last 32 times the prompt took longer than $STALL_MS (default 1000) milliseconds to come" << endl;
+    cout << "back while no foreground job was running, with the phases the shell went through (e.g., prompt, run_line," << endl;
+    cout << "builtin(cd)), the number of jobs, the bytes still queued for the terminal, and what the shell was blocked in." << endl;
+    cout << "Set STALL_MS=0 to stop watching. With -c, forget them." << endl;
+    cout << endl;
+    cout << "true – Do nothing, successfully." << endl;
+    cout << endl;
+    cout << "unalias [-a] NAME ... – Remove the alias for each NAME. With -a, remove every alias." << endl;
+    cout << endl;
+    cout << "z [-l | -x] [TERM ...] – Change to the most frecent (frequently and recently visited) directory whose path" << endl;
+    cout << "contains every TERM, in order. With -l or no TERMs, list the matches and their scores. With -x, remove the current" << endl;
+    cout << "directory from the index. The index is kept in $Z_DATA (default ~/.1730sh_z)." << endl;
+    cout << endl;
     cout << "-- End help --" << endl;
     return 0;  
   } // if/else
@@ -1018,7 +2998,7 @@ int help_builtin(const vector<string> & args) {
 
 int cd_builtin(const vector<string> & args) {
   if(args.size() > 2) { // too many args
-    cout << "1730sh: Usage: cd [PATH]" << endl;
+    cout << "1730sh: Usage: cd [PATH | -]" << endl;
     return -1;
   } // if/else
   // home dir retrieval
@@ -1030,44 +3010,644 @@ int cd_builtin(const vector<string> & args) {
   s_homedir = string(homedir);
   // actual chdir stuff
   if(args.size() == 1) { // 'cd'
-    if(chdir(homedir) == -1) { 
-      int err = errno; 
-      cout << "1730sh: cd: " << homedir << ": " << strerror(err) << endl;
+    return change_dir(s_homedir, false, "cd");
+  } else if(args[1] == "-") { // 'cd -'
+    const char * oldpwd = getenv("OLDPWD");
+    if(oldpwd == nullptr || string(oldpwd) == "") {
+      cout << "1730sh: cd: OLDPWD not set" << endl;
       return -1;
     } // if
-  } else if(args.size() == 2) { // cd [PATH]
-    string dest = args[1];
-    // replaces "~" with full path of HOME
-    size_t pos;
-    if((pos = dest.find("~")) != string::npos) {
-      dest.replace(pos,1,s_homedir);
-    } // if    
-    // current dir retrieval
+    return change_dir(string(oldpwd), true, "cd");
+  } // if/else
+  string dest = args[1];
+  // replaces leading "~" with full path of HOME
+  if(dest == "~" || dest.compare(0,2,"~/") == 0) {
+    dest.replace(0,1,s_homedir);
+  } // if
+  return change_dir(dest, false, "cd");
+} // cd_builtin
+
+int pwd_builtin(const vector<string> & args) {
+  if(args.size() > 2 || (args.size() == 2 && args[1] != "-L" && args[1] != "-P")) {
+    cout << "1730sh: Usage: pwd [-L | -P]" << endl;
+    return -1;
+  } // if
+  if(args.size() == 2 && args[1] == "-P") {
     char cwd[PATH_MAX];
-    string s_cwd = "";
-    if(getcwd(cwd,sizeof(cwd)) == nullptr) { 
-      int err = errno; 
-      cout << "1730sh: cd: " << strerror(err) << endl;
-      return -1;      
+    if(getcwd(cwd,sizeof(cwd)) == nullptr) {
+      int err = errno;
+      cout << "1730sh: pwd: " << strerror(err) << endl;
+      return -1;
     } // if
-    s_cwd = string(cwd);
-    if(dest[0] == '/') { // if dest already started with '/', no need to append to cwd
-      if(chdir(dest.c_str()) == -1) { 
-	int err = errno; 
-	cout << "1730sh: cd: " << dest << ": " << strerror(err) << endl;
+    cout << cwd << endl;
+  } else {
+    cout << logical_pwd << endl;
+  } // if/else
+  return 0;
+} // pwd_builtin
+
+int pushd_builtin(const vector<string> & args) {
+  if(args.size() > 2) {
+    cout << "1730sh: Usage: pushd [DIR]" << endl;
+    return -1;
+  } // if
+  string prev = logical_pwd;
+  if(args.size() == 1) { // swap the top two dirs
+    if(dir_stack.empty()) {
+      cout << "1730sh: pushd: no other directory" << endl;
+      return -1;
+    } // if
+    if(change_dir(dir_stack.front(), false, "pushd") == -1) return -1;
+    dir_stack.front() = prev;
+  } else {
+    vector<string> cd_args = {"cd", args[1]};
+    if(cd_builtin(cd_args) == -1) return -1;
+    dir_stack.insert(dir_stack.begin(), prev);
+  } // if/else
+  return dirs_builtin({"dirs"});
+} // pushd_builtin
+
+int popd_builtin(const vector<string> & args) {
+  if(args.size() != 1) {
+    cout << "1730sh: Usage: popd" << endl;
+    return -1;
+  } // if
+  if(dir_stack.empty()) {
+    cout << "1730sh: popd: directory stack empty" << endl;
+    return -1;
+  } // if
+  if(change_dir(dir_stack.front(), false, "popd") == -1) return -1;
+  dir_stack.erase(dir_stack.begin());
+  return dirs_builtin({"dirs"});
+} // popd_builtin
+
+int dirs_builtin(const vector<string> & args) {
+  if(args.size() > 2 || (args.size() == 2 && args[1] != "-c")) {
+    cout << "1730sh: Usage: dirs [-c]" << endl;
+    return -1;
+  } // if
+  if(args.size() == 2) { // 'dirs -c'
+    dir_stack.clear();
+    return 0;
+  } // if
+  cout << tilde_path(logical_pwd);
+  for(unsigned int i = 0, s = dir_stack.size(); i < s; i++) {
+    cout << " " << tilde_path(dir_stack[i]);
+  } // for
+  cout << endl;
+  return 0;
+} // dirs_builtin
+
+int z_builtin(const vector<string> & args) {
+  bool list = (args.size() == 1);
+  vector<string> terms;
+  for(unsigned int i = 1; i < args.size(); i++) {
+    if(args[i] == "-l") {
+      list = true;
+    } else if(args[i] == "-x") {
+      frecency->forget(logical_pwd);
+      return 0;
+    } else if(args[i][0] == '-') {
+      cout << "1730sh: Usage: z [-l | -x] [TERM ...]" << endl;
+      return -1;
+    } else {
+      terms.push_back(args[i]);
+    } // if/else
+  } // for
+  vector<FrecencyEntry> matches = frecency->query(terms);
+  if(list) { // best match printed last, closest to the prompt
+    for(int i = matches.size() - 1; i >= 0; i--) {
+      cout << std::left << setw(12) << matches[i].rank << matches[i].path << endl;
+    } // for
+    return 0;
+  } // if
+  for(unsigned int i = 0, s = matches.size(); i < s; i++) {
+    if(!is_dir_cached(matches[i].path)) { // stale entry
+      frecency->forget(matches[i].path);
+      continue;
+    } // if
+    return change_dir(matches[i].path, false, "z");
+  } // for
+  cout << "1730sh: z: " << ((terms.empty()) ? "" : terms.back() + ": ") << "no match found" << endl;
+  return -1;
+} // z_builtin
+
+int alias_builtin(const vector<string> & args) {
+  int status = 0;
+  if(args.size() == 1) { // 'alias'
+    for(auto it = aliases.begin(); it != aliases.end(); ++it) {
+      cout << "alias " << it->first << "='" << join_tokens(it->second) << "'" << endl;
+    } // for
+    return 0;
+  } // if
+  for(unsigned int i = 1; i < args.size(); i++) {
+    size_t pos = args[i].find("=");
+    if(pos == string::npos) { // 'alias NAME'
+      auto it = aliases.find(args[i]);
+      if(it == aliases.end()) {
+	cout << "1730sh: alias: " << args[i] << ": not found" << endl;
+	status = -1;
+      } else {
+	cout << "alias " << it->first << "='" << join_tokens(it->second) << "'" << endl;
+      } // if/else
+    } else if(pos == 0 || args[i].find_first_of(" \t|<>&\"") < pos) { // 'alias =VALUE' or bad NAME
+      cout << "1730sh: alias: `" << args[i] << "': invalid alias name" << endl;
+      status = -1;
+    } else { // 'alias NAME=VALUE'
+      vector<string> tokens = lex(args[i].substr(pos+1));
+      if(tokens.empty()) {
+	cout << "1730sh: alias: " << args[i].substr(0,pos) << ": empty expansion" << endl;
+	status = -1;
+      } else {
+	aliases[args[i].substr(0,pos)] = tokens;
+	alias_generation++;
+      } // if/else
+    } // if/else
+  } // for
+  return status;
+} // alias_builtin
+
+int unalias_builtin(const vector<string> & args) {
+  if(args.size() == 1) {
+    cout << "1730sh: Usage: unalias [-a] NAME ..." << endl;
+    return -1;
+  } // if
+  if(args[1] == "-a") {
+    aliases.clear();
+    alias_generation++;
+    return 0;
+  } // if
+  int status = 0;
+  for(unsigned int i = 1; i < args.size(); i++) {
+    if(aliases.erase(args[i]) == 0) {
+      cout << "1730sh: unalias: " << args[i] << ": not found" << endl;
+      status = -1;
+    } else {
+      alias_generation++;
+    } // if/else
+  } // for
+  return status;
+} // unalias_builtin
+
+int set_builtin(const vector<string> & args) {
+  if(args.size() == 1 || (args.size() == 2 && args[1] == "-o")) {
+    for(auto it = shell_options.begin(); it != shell_options.end(); ++it) {
+      cout << std::left << setw(16) << it->first << ((it->second) ? "on" : "off") << endl;
+    } // for
+    return 0;
+  } // if
+  if(args.size() != 3 || (args[1] != "-o" && args[1] != "+o")) {
+    cout << "1730sh: Usage: set [-o | +o] [OPTION]" << endl;
+    return -1;
+  } // if
+  if(shell_options.count(args[2]) == 0) {
+    cout << "1730sh: set: " << args[2] << ": invalid option name" << endl;
+    return -1;
+  } // if
+  shell_options[args[2]] = (args[1] == "-o");
+  if(apply_option(args[2]) == -1) {
+    cout << "1730sh: set: " << args[2] << ": " << strerror(errno) << endl;
+    shell_options[args[2]] = false;
+    return -1;
+  } // if
+  return 0;
+} // set_builtin
+
+int apply_option(const string & name) {
+  if(name == "subreaper") {
+    if(prctl(PR_SET_CHILD_SUBREAPER, (unsigned long) shell_options[name], 0, 0, 0) == -1) return -1;
+    if(!shell_options[name]) { // orphans that haven't exited yet are no longer ours to reap
+      for(auto it = descendants.begin(); it != descendants.end(); ) {
+	it = (it->second.reaped) ? next(it) : descendants.erase(it);
+      } // for
+    } // if
+  } // if
+  return 0;
+} // apply_option
+
+int true_builtin(const vector<string> & args) {
+  return 0;
+} // true_builtin
+
+int false_builtin(const vector<string> & args) {
+  return -1;
+} // false_builtin
+
+int stalls_builtin(const vector<string> & args) {
+  if(args.size() > 2 || (args.size() == 2 && args[1] != "-c")) {
+    cout << "1730sh: Usage: stalls [-c]" << endl;
+    return -1;
+  } else if(watchdog == nullptr) {
+    cout << "1730sh: stalls: only an interactive shell is watched" << endl;
+    return -1;
+  } else if(args.size() == 2) {
+    watchdog->clear();
+    return 0;
+  } // if/else
+  vector<Stall> stalls = watchdog->stalls();
+  if(stalls.empty()) return 0;
+  cout << "STARTED   SECONDS  JOBS  TTY-OUTQ  STATE                    PHASES" << endl;
+  for(const Stall & stall : stalls) {
+    char when[16], seconds[16];
+    struct tm tm;
+    localtime_r(&stall.when, &tm);
+    strftime(when, sizeof(when), "%H:%M:%S", &tm);
+    snprintf(seconds, sizeof(seconds), "%9.3f%s", stall.seconds, (stall.ongoing) ? "+" : " ");
+    string state = string(1, stall.state) + ((stall.wchan != "") ? " " + stall.wchan : "");
+    cout << left << setw(8) << when << seconds << right << setw(5) << stall.jobs << setw(10) << stall.outputQueued
+	 << "  " << left << setw(24) << state << " " << stall.phases << right << endl;
+  } // for
+  return 0;
+} // stalls_builtin
+
+int sleep_builtin(const vector<string> & args) {
+  if(args.size() < 2) {
+    cout << "1730sh: Usage: sleep NUMBER[s|m|h|d] ..." << endl;
+    return -1;
+  } // if
+  double seconds = 0;
+  for(unsigned int i = 1; i < args.size(); i++) {
+    char * end;
+    double n = strtod(args[i].c_str(), &end);
+    string unit(end);
+    const map<string, double> units = {{"", 1}, {"s", 1}, {"m", 60}, {"h", 3600}, {"d", 86400}};
+    if(end == args[i].c_str() || n < 0 || units.count(unit) == 0) {
+      cout << "1730sh: sleep: invalid time interval '" << args[i] << "'" << endl;
+      return -1;
+    } // if
+    seconds += n * units.at(unit);
+  } // for
+  return event_wait(seconds);
+} // sleep_builtin
+
+int basename_builtin(const vector<string> & args) {
+  if(args.size() < 2 || args.size() > 3) {
+    cout << "1730sh: Usage: basename NAME [SUFFIX]" << endl;
+    return -1;
+  } // if
+  string name = args[1];
+  size_t last = name.find_last_not_of('/');
+  if(last == string::npos) { // empty or all slashes
+    cout << ((name == "") ? "" : "/") << endl;
+    return 0;
+  } // if
+  name.erase(last + 1);
+  name.erase(0, name.find_last_of('/') + 1); // npos + 1 == 0
+  if(args.size() == 3 && args[2].size() < name.size() &&
+     name.compare(name.size() - args[2].size(), args[2].size(), args[2]) == 0) {
+    name.erase(name.size() - args[2].size());
+  } // if
+  cout << name << endl;
+  return 0;
+} // basename_builtin
+
+int dirname_builtin(const vector<string> & args) {
+  if(args.size() != 2) {
+    cout << "1730sh: Usage: dirname NAME" << endl;
+    return -1;
+  } // if
+  string name = args[1];
+  size_t last = name.find_last_not_of('/');
+  if(last == string::npos) { // empty or all slashes
+    cout << ((name == "") ? "." : "/") << endl;
+    return 0;
+  } // if
+  size_t slash = name.find_last_of('/', last);
+  if(slash == string::npos) {
+    cout << "." << endl;
+    return 0;
+  } // if
+  size_t end = name.find_last_not_of('/', slash);
+  cout << ((end == string::npos) ? "/" : name.substr(0, end + 1)) << endl;
+  return 0;
+} // dirname_builtin
+
+int printenv_builtin(const vector<string> & args) {
+  if(args.size() == 1) {
+    for(char ** env = environ; *env != nullptr; env++) cout << *env << endl;
+    return 0;
+  } // if
+  int status = 0;
+  for(unsigned int i = 1; i < args.size(); i++) {
+    const char * value = getenv(args[i].c_str());
+    if(value == nullptr) {
+      status = -1;
+    } else {
+      cout << value << endl;
+    } // if/else
+  } // for
+  return status;
+} // printenv_builtin
+
+int profile_builtin(const vector<string> & args) {
+  if(args.size() == 1) {
+    size_t dropped;
+    size_t samples = sampler_count(dropped);
+    cout << "profile: " << ((sampler_running()) ? "running" : "stopped") << " (" << sampler_clock() << "), "
+	 << with_commas(samples) << " samples";
+    if(dropped > 0) cout << " (" << with_commas(dropped) << " dropped)";
+    cout << endl;
+    return 0;
+  } else if(args[1] == "start" && args.size() <= 3) {
+    unsigned long hz = PROFILE_HZ;
+    if(args.size() == 3) {
+      char * end;
+      hz = strtoul(args[2].c_str(), &end, 10);
+      if(*end != '\0' || hz == 0 || hz > 1000000) {
+	cout << "1730sh: profile: " << args[2] << ": invalid rate" << endl;
 	return -1;
       } // if
-    } else { // dest was a relative path, so need to append '/' + dest to cwd
-      s_cwd = s_cwd + "/" + dest;
-      if(chdir(s_cwd.c_str()) == -1) { 
-	int err = errno; 
-	cout << "1730sh: cd: " << dest << ": " << strerror(err) << endl;
+    } // if
+    if(sampler_start(hz) == -1) {
+      cout << "1730sh: profile: " << strerror(errno) << endl;
+      return -1;
+    } // if
+    return 0;
+  } else if(args[1] == "stop" && args.size() == 2) {
+    if(sampler_stop() == -1) {
+      cout << "1730sh: profile: " << strerror(errno) << endl;
+      return -1;
+    } // if
+    return 0;
+  } else if(args[1] == "dump" && args.size() == 2) {
+    sampler_dump(cout);
+    return 0;
+  } // if/else
+  cout << "1730sh: Usage: profile [start [HZ] | stop | dump]" << endl;
+  return -1;
+} // profile_builtin
+
+int read_builtin(const vector<string> & args) {
+  vector<string> names(args.begin() + 1, args.end());
+  if(names.empty()) names.push_back("REPLY");
+  for(unsigned int i = 0; i < names.size(); i++) {
+    if(names[i].find('=') != string::npos) {
+      cout << "1730sh: read: " << names[i] << ": not a valid name" << endl;
+      return -1;
+    } // if
+  } // for
+  string line;
+  char c;
+  ssize_t n;
+  bool eof = true;
+  while((n = read(STDIN_FILENO, &c, 1)) == 1 || (n == -1 && errno == EINTR)) {
+    if(n != 1) continue;
+    eof = false;
+    if(c == '\n') break;
+    line += c;
+  } // while
+  if(n == -1) {
+    cout << "1730sh: read: " << strerror(errno) << endl;
+    return -1;
+  } // if
+  istringstream ss(line);
+  for(unsigned int i = 0; i < names.size(); i++) {
+    string value;
+    if(i == names.size() - 1) {
+      getline(ss >> ws, value);
+      value.erase(value.find_last_not_of(" \t") + 1);
+    } else {
+      ss >> value;
+    } // if/else
+    setenv(names[i].c_str(), value.c_str(), 1);
+  } // for
+  return (eof) ? -1 : 0;
+} // read_builtin
+
+int echo_builtin(const vector<string> & args) {
+  bool newline = !(args.size() > 1 && args[1] == "-n");
+  unsigned int first = (newline) ? 1 : 2;
+  for(unsigned int i = first; i < args.size(); i++) {
+    if(i > first) cout << " ";
+    cout << args[i];
+  } // for
+  if(newline) cout << endl;
+  return 0;
+} // echo_builtin
+
+int enqueue_builtin(const vector<string> & args) {
+  unsigned int first = (args.size() > 2 && args[1] == "-d") ? 3 : 1;
+  if(args.size() <= first) {
+    cout << "1730sh: Usage: enqueue [-d SPOOLDIR] COMMAND [ARG ...]" << endl;
+    return -1;
+  } // if
+  const char * env = getenv("SPOOL");
+  string dir = (first == 3) ? args[2] : (env != nullptr && env[0] != '\0') ? string(env) : home_path(".1730sh_spool");
+  if(spool != nullptr && spool->path() != dir) {
+    delete spool;
+    spool = nullptr;
+  } // if
+  if(spool == nullptr) {
+    spool = new Spool(dir);
+    if(spool->open(true) == -1) {
+      cout << "1730sh: enqueue: " << dir << ": " << strerror(errno) << endl;
+      delete spool;
+      spool = nullptr;
+      return -1;
+    } // if
+  } // if
+  // the command line itself, not re-quoted tokens, so the drainer parses it as typed
+  string command = args[first];
+  for(unsigned int i = first + 1; i < args.size(); i++) command += " " + args[i];
+  if(spool->enqueue(command) == -1) {
+    cout << "1730sh: enqueue: " << dir << ": " << strerror(errno) << endl;
+    return -1;
+  } // if
+  return 0;
+} // enqueue_builtin
+
+/**
+ * Replaces the backslash escapes \n, \t, \\ and \" in the given string with the characters
+ * they stand for.
+ */
+static string unescape(const string & str) {
+  string out;
+  for(unsigned int i = 0; i < str.size(); i++) {
+    if(str[i] != '\\' || i + 1 == str.size()) {
+      out += str[i];
+      continue;
+    } // if
+    switch(str[++i]) {
+    case 'n': out += '\n'; break;
+    case 't': out += '\t'; break;
+    case '\\': out += '\\'; break;
+    case '"': out += '"'; break;
+    default: out += '\\'; out += str[i];
+    } // switch
+  } // for
+  return out;
+} // unescape
+
+int printf_builtin(const vector<string> & args) {
+  if(args.size() < 2) {
+    cout << "1730sh: Usage: printf FORMAT [ARG ...]" << endl;
+    return -1;
+  } // if
+  string format = unescape(args[1]);
+  unsigned int next = 2;
+  int status = 0;
+  string out;
+  do {
+    bool consumed = false;
+    for(unsigned int i = 0; i < format.size(); i++) {
+      if(format[i] != '%') {
+	out += format[i];
+	continue;
+      } // if
+      if(i + 1 < format.size() && format[i+1] == '%') {
+	out += '%';
+	i++;
+	continue;
+      } // if
+      // a conversion: %[flags][width][.precision]conversion
+      size_t end = format.find_first_of("sbcdiuoxXeEfgG", i + 1);
+      if(end == string::npos || format.find_first_not_of("-+ #0123456789.", i + 1) != end) {
+	cout << "1730sh: printf: invalid format: " << format.substr(i) << endl;
 	return -1;
       } // if
-    } // if/else
+      string spec = format.substr(i, end - i);
+      char conv = format[end];
+      string arg = (next < args.size()) ? args[next++] : "";
+      consumed = true;
+      // formats one value onto the end of out, sized by a first snprintf() that only counts
+      auto append = [&out](const string & fmt, auto value) {
+	int len = snprintf(nullptr, 0, fmt.c_str(), value);
+	if(len <= 0) return;
+	size_t at = out.size();
+	out.resize(at + len + 1);
+	snprintf(&out[at], len + 1, fmt.c_str(), value);
+	out.resize(at + len);
+      };
+      char * endp = nullptr;
+      errno = 0;
+      if(conv == 's' || conv == 'b') {
+	append(spec + "s", ((conv == 'b') ? unescape(arg) : arg).c_str());
+      } else if(conv == 'c') {
+	if(arg == "") append(spec + "s", ""); // pads, but prints no NUL
+	else append(spec + "c", arg[0]);
+      } else if(conv == 'd' || conv == 'i') {
+	long long value = strtoll((arg == "") ? "0" : arg.c_str(), &endp, 0);
+	append(spec + "lld", value);
+      } else if(conv == 'u' || conv == 'o' || conv == 'x' || conv == 'X') {
+	unsigned long long value = strtoull((arg == "") ? "0" : arg.c_str(), &endp, 0);
+	append(spec + "ll" + conv, value);
+      } else {
+	double value = strtod((arg == "") ? "0" : arg.c_str(), &endp);
+	append(spec + conv, value);
+      } // if/else
+      if(endp != nullptr && (*endp != '\0' || errno != 0)) {
+	cout << "1730sh: printf: " << arg << ": invalid number" << endl;
+	status = -1;
+      } // if
+      i = end;
+    } // for
+    if(!consumed) break; // no conversions, so the args would never run out
+  } while(next < args.size());
+  cout << out << flush;
+  return status;
+} // printf_builtin
+
+int event_wait(double seconds) {
+  // SIGCHLD and SIGINT are blocked and read from a signalfd instead. a blocked SIGINT is
+  // queued even though the shell ignores it, so ^C still ends the wait
+  sigset_t mask, oldmask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  if(sigprocmask(SIG_BLOCK, &mask, &oldmask) == -1) return -1;
+  int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+  int status = 0;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while(sfd != -1) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double left = seconds - (now.tv_sec - start.tv_sec) - (now.tv_nsec - start.tv_nsec) / 1e9;
+    if(left <= 0) break;
+    struct pollfd pfd = {sfd, POLLIN, 0};
+    int n = poll(&pfd, 1, (left > INT_MAX / 1000) ? INT_MAX : (int) (left * 1000) + 1);
+    if(n == -1 && errno != EINTR) { status = -1; break; } // if
+    if(n <= 0) continue;
+    struct signalfd_siginfo si;
+    if(read(sfd, &si, sizeof(si)) != sizeof(si)) continue;
+    if(si.ssi_signo == SIGINT) {
+      cout << endl;
+      status = -1;
+      break;
+    } // if
+    check_current_jobs(); // SIGCHLD
+  } // while
+  if(sfd == -1) { // no signalfd, so just sleep
+    struct timespec ts = {(time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9)};
+    while(nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+  } else {
+    close(sfd);
   } // if/else
-  return 0;
-} // cd_builtin
+  sigprocmask(SIG_SETMASK, &oldmask, nullptr);
+  return status;
+} // event_wait
+
+vector<string> optimize_pipeline(Input * job) {
+  vector<string> rewrites;
+  vector<Process> & procs = job->getProcesses();
+  string before = describe_job(job);
+  // 'cat FILE | CMD' => 'CMD < FILE'. only if FILE is readable, so errors are still cat's to report
+  if(procs.size() > 1 && job->getSTDIN_fd() == "STDIN_FILENO" && procs[0].args.size() == 2 &&
+     procs[0].args[0] == "cat" && procs[0].args[1][0] != '-' && access(procs[0].args[1].c_str(), R_OK) == 0) {
+    job->setSTDIN_fd(procs[0].args[1]);
+    procs.erase(procs.begin());
+  } // if
+  for(unsigned int i = 0; i < procs.size() && procs.size() > 1; ) {
+    // a first stage is only dropped if the stage after it would not end up reading a terminal
+    if(!isIdentityStage(procs[i].args) || (i == 0 && job->getSTDIN_fd() == "STDIN_FILENO")) {
+      i++;
+      continue;
+    } // if
+    if(i == procs.size() - 1) {
+      // the stage before would write straight to the job's stdout/stderr instead of a pipe
+      bool tty_out = (job->getSTDOUT_fd() == "STDOUT_FILENO" && isatty(STDOUT_FILENO));
+      if(tty_out || job->getSTDERR_fd() != "STDERR_FILENO") break;
+      procs.pop_back();
+      procs.back().hasPipe = false;
+    } else {
+      procs.erase(procs.begin() + i);
+    } // if/else
+  } // for
+  string after = describe_job(job);
+  if(after != before) rewrites.push_back("`" + before + "' => `" + after + "'");
+  return rewrites;
+} // optimize_pipeline
+
+bool isIdentityStage(const vector<string> & args) {
+  if(args.size() == 1) return args[0] == "cat" || args[0] == "tee";
+  return args.size() == 2 && args[0] == "tee" && args[1] == "/dev/null";
+} // isIdentityStage
+
+string describe_job(Input * job) {
+  string desc = "";
+  vector<Process> & procs = job->getProcesses();
+  for(unsigned int i = 0; i < procs.size(); i++) {
+    if(i > 0) desc += " | ";
+    desc += join_tokens(procs[i].args);
+  } // for
+  if(job->getSTDIN_fd() != "STDIN_FILENO") desc += " < " + job->getSTDIN_fd();
+  if(job->getSTDOUT_fd() != "STDOUT_FILENO") desc += " " + job->getSTDOUT_type() + " " + job->getSTDOUT_fd();
+  if(job->getSTDERR_fd() != "STDERR_FILENO") desc += " " + job->getSTDERR_type() + " " + job->getSTDERR_fd();
+  if(!job->isForeground()) desc += " &";
+  return desc;
+} // describe_job
+
+string join_tokens(const vector<string> & tokens) {
+  string joined = "";
+  for(unsigned int i = 0; i < tokens.size(); i++) {
+    if(i > 0) joined += " ";
+    if(tokens[i].find_first_of(" \t") != string::npos || tokens[i][0] == LITERAL) {
+      joined += "\"" + unmark(tokens[i]) + "\"";
+    } else {
+      joined += tokens[i];
+    } // if/else
+  } // for
+  return joined;
+} // join_tokens
 
 int export_builtin(const vector<string> & args) {
   if(args.size() != 2) {
@@ -1088,6 +3668,7 @@ int export_builtin(const vector<string> & args) {
 	  cout << "1730sh: export: " << str << ": " << strerror(err) << endl;
 	  return -1;
 	} // if
+	if(rc_recording) rc_exports.insert(name);
       } // if/else
     } else { // user entered something like 'NAME'
       string name = str;
@@ -1097,6 +3678,7 @@ int export_builtin(const vector<string> & args) {
 	cout << "1730sh: export: " << str << ": " << strerror(err) << endl;
 	return -1;
       } // if
+      if(rc_recording) rc_exports.insert(name);
     } // if/else
   } // if/else
   return 0;
@@ -1173,8 +3755,44 @@ int bg_builtin(const vector<string> & args) {
 } // bg_builtin
 
 int jobs_builtin(const vector<string> & args) {
+  if(args.size() == 2 && args[1] == "-a") { // descendants tracked while a subreaper
+    if(shell_options["subreaper"]) {
+      track_descendants();
+      reap_orphans();
+    } // if
+    cout << std::left << setw(8) << "PID" << setw(8) << "JID" << setw(24) << "STATUS" << "COMMAND" << endl;
+    for(auto it = descendants.begin(); it != descendants.end(); ) {
+      const Descendant & d = it->second;
+      string status = (d.orphaned) ? "Orphaned" : "Running";
+      if(d.reaped) {
+	stringstream ss;
+	ss << "Exited (";
+	if(WIFSIGNALED(d.status)) {
+	  ss << strsignal(WTERMSIG(d.status));
+	} else {
+	  ss << WEXITSTATUS(d.status);
+	} // if/else
+	ss << ") " << fixed << setprecision(2)
+	   << d.usage.ru_utime.tv_sec + d.usage.ru_utime.tv_usec / 1e6 + d.usage.ru_stime.tv_sec + d.usage.ru_stime.tv_usec / 1e6
+	   << "s";
+	status = ss.str();
+      } // if
+      cout << std::left << setw(8) << it->first << setw(8) << ((d.jid != 0) ? to_string(d.jid) : "-")
+	   << setw(24) << status << d.comm;
+      if(d.job != "") cout << " (from: " << d.job << ")";
+      cout << endl;
+      it = (d.reaped) ? descendants.erase(it) : next(it); // exits are reported once
+    } // for
+    return 0;
+  } // if
+  if(args.size() == 2 && args[1] == "-x") { // exits that were summarized
+    for(unsigned int i = 0; i < exited_log.size(); i++) cout << exited_log[i] << "\n";
+    cout << flush;
+    exited_log.clear();
+    return 0;
+  } // if
   if(args.size() != 1) {
-    cout << "1730sh: Usage: jobs" << endl;
+    cout << "1730sh: Usage: jobs [-a | -x]" << endl;
   } else {
     cout << std::left << setw(8) << "JID" << setw(13) << "STATUS" << "COMMAND" << endl;
     for(unsigned int i = 0, s = current_jobs.size(); i < s; i++) {
@@ -0,0 +1,105 @@
+
+#include <cstdint>
+#include <new>
+#include <unistd.h>
+#include "Arena.h"
+
+using namespace std;
+
+// ___________ constructors/destructors ____________ //
+
+Arena::Arena(int advice) : advice(advice) {} // constructor
+
+Arena::~Arena() {
+  for(unsigned int i = 0; i < chunks.size(); i++) munmap(chunks[i], CHUNK_SIZE);
+} // destructor
+
+//_____________ caches() _____________ //
+
+Arena & Arena::caches() {
+  static Arena * arena = new Arena(MADV_DONTFORK);
+  return *arena;
+} // caches
+
+//_____________ map(size_t) _____________ //
+
+void * Arena::map(size_t size) {
+  void * addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(addr == MAP_FAILED) return nullptr;
+  // WIPEONFORK needs Linux 4.14, so fall back to DONTFORK where it's missing
+  if(madvise(addr, size, advice) == -1 && advice != MADV_DONTFORK) {
+    madvise(addr, size, MADV_DONTFORK);
+  } // if
+  this->bytesMapped += size;
+  return addr;
+} // map
+
+//_____________ sizeClass(size_t) _____________ //
+
+int Arena::sizeClass(size_t size) {
+  int cls = 0;
+  for(size_t s = MIN_CLASS; s < size; s <<= 1) cls++;
+  return cls;
+} // sizeClass
+
+//_____________ allocate(size_t) _____________ //
+
+void * Arena::allocate(size_t size) {
+  if(size > MAX_SMALL) { // large blocks get their own mapping
+    size_t page = sysconf(_SC_PAGESIZE);
+    void * block = map((size + page - 1) / page * page);
+    if(block == nullptr) throw bad_alloc();
+    return block;
+  } // if
+  int cls = sizeClass(size);
+  if(freeLists[cls] != nullptr) {
+    void * block = freeLists[cls];
+    freeLists[cls] = *(void **) block;
+    return block;
+  } // if
+  size_t classSize = MIN_CLASS << cls;
+  if(cursor == nullptr || (size_t) (limit - cursor) < classSize) {
+    char * chunk = (char *) map(CHUNK_SIZE);
+    if(chunk == nullptr) throw bad_alloc();
+    chunks.push_back(chunk);
+    this->cursor = chunk;
+    this->limit = chunk + CHUNK_SIZE;
+  } // if
+  void * block = cursor;
+  this->cursor += classSize;
+  return block;
+} // allocate
+
+//_____________ deallocate(void*, size_t) _____________ //
+
+void Arena::deallocate(void * block, size_t size) {
+  if(block == nullptr) return;
+  if(size > MAX_SMALL) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t len = (size + page - 1) / page * page;
+    munmap(block, len);
+    this->bytesMapped -= len;
+    return;
+  } // if
+  int cls = sizeClass(size);
+  *(void **) block = freeLists[cls];
+  freeLists[cls] = block;
+} // deallocate
+
+//_____________ forget() _____________ //
+
+void Arena::forget() {
+  this->cursor = nullptr;
+  this->limit = nullptr;
+  for(int i = 0; i < NUM_CLASSES; i++) freeLists[i] = nullptr;
+  chunks.clear();
+  this->bytesMapped = 0;
+} // forget
+
+// _______________ non-member helper methods ______________ //
+
+void dontfork(const void * addr, size_t len) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t) addr / page * page;
+  madvise((void *) start, len + ((uintptr_t) addr - start), MADV_DONTFORK);
+} // dontfork
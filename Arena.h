@@ -0,0 +1,133 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+
+/**
+ * An allocator for the shell's large in-memory caches. Every region it maps is marked
+ * MADV_DONTFORK (or MADV_WIPEONFORK), so fork() doesn't copy its page tables and the
+ * children created between fork() and exec() never map (or fault on) the caches. Memory
+ * allocated here must therefore NEVER be touched in a child process.
+ *
+ * Small blocks come from size-classed free lists carved out of 1 MB chunks. Large blocks
+ * are mapped individually.
+ */
+class Arena {
+ private:
+  static const size_t CHUNK_SIZE = 1 << 20;
+  static const size_t MIN_CLASS = 16;
+  static const size_t MAX_SMALL = 4096;
+  static const int NUM_CLASSES = 9; // 16, 32, ..., 4096
+  int advice;
+  char * cursor = nullptr;
+  char * limit = nullptr;
+  void * freeLists[NUM_CLASSES] = {};
+  std::vector<char *> chunks;
+  size_t bytesMapped = 0;
+
+  /**
+   * Maps the given number of bytes and applies the fork advice to them.
+   *
+   * @return the mapped region, or nullptr upon failure
+   */
+  void * map(size_t);
+  /**
+   * Gets the size class of the given block size.
+   *
+   * @return the index of the smallest class that fits the size
+   */
+  static int sizeClass(size_t);
+ public:
+  /**
+   * Constructor.
+   *
+   * @param advice MADV_DONTFORK (children don't map the regions at all) or MADV_WIPEONFORK
+   *        (children see them zero-filled)
+   */
+  Arena(int advice = MADV_DONTFORK);
+  /**
+   * Destructor. Unmaps every chunk. Large blocks that were never deallocated are leaked.
+   */
+  ~Arena();
+  /**
+   * Gets the arena shared by all of the shell's caches. It is never destroyed, so that no
+   * destructor ever walks it in a child that exit()s.
+   *
+   * @return the cache arena
+   */
+  static Arena & caches();
+  /**
+   * Allocates a block of at least the given size, aligned to 16 bytes.
+   *
+   * @param size_t the size of the block
+   * @return the block. Throws std::bad_alloc upon failure
+   */
+  void * allocate(size_t);
+  /**
+   * Frees the given block.
+   *
+   * @param void* the block
+   * @param size_t the size with which the block was allocated
+   */
+  void deallocate(void *, size_t);
+  /**
+   * Forgets every block, without unmapping anything, so that a forked child (which didn't
+   * inherit the arena's regions) can allocate from it. Containers holding blocks from before
+   * the fork must be abandoned, not destroyed, since their blocks were never mapped here.
+   */
+  void forget();
+  /**
+   * Gets the total number of bytes this arena has mapped.
+   *
+   * @return the bytes mapped
+   */
+  size_t mapped() const { return bytesMapped; }
+
+}; // Arena
+
+/**
+ * Allocator for standard containers whose memory should live in Arena::caches().
+ */
+template <typename T> struct ArenaAllocator {
+  typedef T value_type;
+  ArenaAllocator() noexcept {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &) noexcept {}
+  T * allocate(size_t n) { return static_cast<T *>(Arena::caches().allocate(n * sizeof(T))); }
+  void deallocate(T * p, size_t n) noexcept { Arena::caches().deallocate(p, n * sizeof(T)); }
+}; // ArenaAllocator
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+/**
+ * A string whose characters live in the cache arena.
+ */
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> arena_string;
+
+/**
+ * Transparent less-than for maps keyed by arena_string, so they can be searched with a
+ * std::string (or another arena_string) without copying the key into the arena.
+ */
+struct ArenaLess {
+  typedef void is_transparent;
+  template <typename A, typename B> bool operator()(const A & a, const B & b) const {
+    return a.compare(0, a.size(), b.data(), b.size()) < 0;
+  } // operator()
+}; // ArenaLess
+
+/**
+ * Applies MADV_DONTFORK to an existing mapping (e.g., an mmap'd cache file), so that
+ * children don't inherit it either.
+ *
+ * @param addr the start of the mapping
+ * @param len the length of the mapping
+ */
+void dontfork(const void * addr, size_t len);
+
+#endif
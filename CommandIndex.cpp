@@ -0,0 +1,231 @@
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "CommandIndex.h"
+#include "Input.h"
+
+using namespace std;
+
+//_____________ Pattern _____________ //
+
+CommandIndex::Pattern::Pattern(const string & str): str(str) {
+  if(str.size() > 64) return; // too long for one word, so distance() falls back to the table
+  for(size_t i = 0; i < str.size(); i++) this->peq[(unsigned char) str[i]] |= 1ULL << i;
+} // constructor
+
+unsigned int CommandIndex::Pattern::distance(const string & other) const {
+  size_t m = this->str.size();
+  if(m == 0) return other.size();
+  if(m > 64) {
+    // plain dynamic programming
+    vector<unsigned int> prev(other.size() + 1), cur(other.size() + 1);
+    for(size_t j = 0; j <= other.size(); j++) prev[j] = j;
+    for(size_t i = 1; i <= m; i++) {
+      cur[0] = i;
+      for(size_t j = 1; j <= other.size(); j++) {
+	cur[j] = min(min(prev[j] + 1, cur[j-1] + 1), prev[j-1] + ((this->str[i-1] == other[j-1]) ? 0 : 1));
+      } // for
+      swap(prev, cur);
+    } // for
+    return prev[other.size()];
+  } // if
+  // each bit of Pv/Mv says whether a column of the DP table goes up/down by one from the
+  // row above it; score tracks the bottom row
+  uint64_t pv = ~0ULL, mv = 0, last = 1ULL << (m - 1);
+  unsigned int score = m;
+  for(size_t j = 0; j < other.size(); j++) {
+    uint64_t eq = this->peq[(unsigned char) other[j]];
+    uint64_t xv = eq | mv;
+    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+    if(ph & last) {
+      score++;
+    } else if(mh & last) {
+      score--;
+    } // if/else
+    ph = (ph << 1) | 1; // the top row goes up by one per char
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  } // for
+  return score;
+} // distance
+
+//_____________ addVariant(const string&, uint32_t) _____________ //
+
+void CommandIndex::addVariant(const string & variant, uint32_t node) {
+  if(2 * (this->variantCount + 1) > this->variants.size()) { // grows to stay at most half full
+    vector<uint64_t> old;
+    old.swap(this->variants);
+    this->variants.assign((old.empty()) ? 1024 : 2 * old.size(), 0);
+    for(uint64_t entry : old) {
+      if(entry == 0) continue;
+      size_t mask = this->variants.size() - 1;
+      for(size_t i = (entry >> 32) & mask; ; i = (i + 1) & mask) {
+	if(this->variants[i] == 0) {
+	  this->variants[i] = entry;
+	  break;
+	} // if
+      } // for
+    } // for
+  } // if
+  uint64_t hash = (fnv1a(variant.data(), variant.size()) & 0xFFFFFFFF) | 1; // never 0
+  uint64_t entry = (hash << 32) | node;
+  size_t mask = this->variants.size() - 1;
+  for(size_t i = hash & mask; ; i = (i + 1) & mask) {
+    if(this->variants[i] == entry) return; // e.g., both deletions of "aa"
+    if(this->variants[i] == 0) {
+      this->variants[i] = entry;
+      this->variantCount++;
+      return;
+    } // if
+  } // for
+} // addVariant
+
+//_____________ findVariant(const string&, set<uint32_t>&) _____________ //
+
+void CommandIndex::findVariant(const string & variant, set<uint32_t> & found) const {
+  if(this->variants.empty()) return;
+  uint64_t hash = (fnv1a(variant.data(), variant.size()) & 0xFFFFFFFF) | 1;
+  size_t mask = this->variants.size() - 1;
+  for(size_t i = hash & mask; this->variants[i] != 0; i = (i + 1) & mask) {
+    if((this->variants[i] >> 32) == hash) found.insert(this->variants[i] & 0xFFFFFFFF);
+  } // for
+} // findVariant
+
+//_____________ add(const string&) _____________ //
+
+void CommandIndex::add(const string & name) {
+  if(name == "" || !this->names.insert(name).second) return;
+  uint32_t id = this->nodes.size();
+  this->addVariant(name, id);
+  for(size_t i = 0; i < name.size(); i++) this->addVariant(string(name).erase(i, 1), id);
+  Node node;
+  node.name = name;
+  if(this->nodes.empty()) {
+    this->nodes.push_back(node);
+    return;
+  } // if
+  Pattern pattern(name);
+  size_t cur = 0;
+  while(true) {
+    unsigned int d = pattern.distance(this->nodes[cur].name);
+    auto & children = this->nodes[cur].children;
+    auto it = lower_bound(children.begin(), children.end(), make_pair(d, (uint32_t) 0));
+    if(it == children.end() || it->first != d) {
+      children.insert(it, make_pair(d, (uint32_t) this->nodes.size()));
+      this->nodes.push_back(node);
+      return;
+    } // if
+    cur = it->second;
+  } // while
+} // add
+
+//_____________ refresh(const string&) _____________ //
+
+void CommandIndex::refresh(const string & path) {
+  stringstream ss(path);
+  string dir;
+  while(getline(ss, dir, ':')) {
+    if(dir == "") dir = ".";
+    struct stat sb;
+    if(stat(dir.c_str(), &sb) == -1 || !S_ISDIR(sb.st_mode)) continue;
+    auto it = this->dirs.find(dir);
+    if(it != this->dirs.end() && it->second.tv_sec == sb.st_mtim.tv_sec && it->second.tv_nsec == sb.st_mtim.tv_nsec) {
+      continue; // unchanged since it was scanned
+    } // if
+    this->dirs[dir] = sb.st_mtim;
+    DIR * d = opendir(dir.c_str());
+    if(d == nullptr) continue;
+    struct dirent * entry;
+    while((entry = readdir(d)) != nullptr) {
+      if(entry->d_name[0] == '.') continue;
+      if(entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) continue;
+      // checking each for exec permission would cost a syscall per name; callers validate
+      this->add(entry->d_name);
+    } // while
+    closedir(d);
+  } // while
+} // refresh
+
+//_____________ suggest(const string&, unsigned int) _____________ //
+
+vector<string> CommandIndex::suggest(const string & name, unsigned int maxDistance) const {
+  vector<pair<unsigned int, string>> found;
+  if(this->nodes.empty() || maxDistance == 0) return {};
+  // one edit away: some one-char deletion (or none) of the name matches one of a candidate's
+  set<uint32_t> candidates;
+  this->findVariant(name, candidates);
+  for(size_t i = 0; i < name.size(); i++) this->findVariant(string(name).erase(i, 1), candidates);
+  for(uint32_t id : candidates) {
+    unsigned int d = distance(name, this->nodes[id].name); // also weeds out hash collisions
+    if(d == 1) found.push_back(make_pair(d, this->nodes[id].name));
+  } // for
+  if(!found.empty() || maxDistance == 1) {
+    sort(found.begin(), found.end());
+    vector<string> suggestions;
+    for(unsigned int i = 0; i < found.size(); i++) suggestions.push_back(found[i].second);
+    return suggestions;
+  } // if
+  // further away, through the tree. candidates are measured again with swaps counted as one.
+  // a swap is two Levenshtein edits, so the tree is searched to twice the distance: a name
+  // maxDistance swaps away is 2 * maxDistance away by the tree's own distance
+  unsigned int reach = 2 * maxDistance;
+  Pattern pattern(name);
+  vector<size_t> stack{0};
+  while(!stack.empty()) {
+    const Node & node = this->nodes[stack.back()];
+    stack.pop_back();
+    unsigned int d = pattern.distance(node.name);
+    if(d <= reach && d > 0) {
+      unsigned int od = distance(name, node.name);
+      if(od <= maxDistance) found.push_back(make_pair(od, node.name));
+    } // if
+    // by the triangle inequality, only children within reach of d can match
+    unsigned int low = (d > reach) ? d - reach : 0;
+    for(unsigned int i = 0; i < node.children.size() && node.children[i].first <= d + reach; i++) {
+      if(node.children[i].first >= low) stack.push_back(node.children[i].second);
+    } // for
+  } // while
+  sort(found.begin(), found.end());
+  vector<string> suggestions;
+  for(unsigned int i = 0; i < found.size(); i++) suggestions.push_back(found[i].second);
+  return suggestions;
+} // suggest
+
+//_____________ distance(const string&, const string&) _____________ //
+
+unsigned int CommandIndex::distance(const string & a, const string & b) {
+  // optimal string alignment, keeping only the last three rows. lookups compute this for
+  // every node visited, so short names (nearly all of them) use rows on the stack
+  const size_t MAX_STACK = 64;
+  size_t n = b.size();
+  unsigned int stackRows[3][MAX_STACK + 1];
+  vector<unsigned int> heapRows;
+  unsigned int * prev2 = stackRows[0], * prev = stackRows[1], * cur = stackRows[2];
+  if(n > MAX_STACK) {
+    heapRows.resize(3 * (n + 1));
+    prev2 = &heapRows[0];
+    prev = prev2 + n + 1;
+    cur = prev + n + 1;
+  } // if
+  for(size_t j = 0; j <= n; j++) prev[j] = j;
+  for(size_t i = 1; i <= a.size(); i++) {
+    cur[0] = i;
+    for(size_t j = 1; j <= n; j++) {
+      unsigned int cost = (a[i-1] == b[j-1]) ? 0 : 1;
+      cur[j] = min(min(prev[j] + 1, cur[j-1] + 1), prev[j-1] + cost);
+      if(i > 1 && j > 1 && a[i-1] == b[j-2] && a[i-2] == b[j-1]) cur[j] = min(cur[j], prev2[j-2] + 1);
+    } // for
+    unsigned int * oldest = prev2;
+    prev2 = prev;
+    prev = cur;
+    cur = oldest;
+  } // for
+  return prev[n];
+} // distance
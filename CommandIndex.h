@@ -0,0 +1,99 @@
+#ifndef COMMANDINDEX_H
+#define COMMANDINDEX_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * An index of command names (builtins and the executables in $PATH) for suggesting the
+ * command a typo was meant to be. Most typos are one edit away (a char inserted, dropped,
+ * changed, or swapped with its neighbor), and those are found through a symmetric deletion
+ * index: every name is filed under itself and each way of deleting one of its chars, so a
+ * lookup only has to probe the typo and its own one-char deletions.
+ *
+ * Names further away are found through a BK-tree keyed by Levenshtein distance, which only
+ * visits the part of the tree within reach of the typo. Distances from the name being looked
+ * up (or added) are computed with the bit-parallel algorithm of Myers and Hyyro, in a few
+ * word operations per char.
+ *
+ * The index is updated incrementally: refresh() only rescans the $PATH dirs that are new or
+ * whose mtime changed. Names are never removed from the tree, so callers should check that a
+ * suggestion still exists.
+ */
+class CommandIndex {
+ private:
+  /**
+   * A name prepared for computing its Levenshtein distance to many others.
+   */
+  class Pattern {
+   private:
+    const std::string & str;
+    uint64_t peq[256] = {0}; // for each char, the bits of the positions it occurs at
+   public:
+    Pattern(const std::string & str);
+    unsigned int distance(const std::string & other) const;
+  }; // Pattern
+  struct Node {
+    std::string name;
+    std::vector<std::pair<unsigned int, uint32_t>> children; // (edit distance, node), sorted
+  }; // Node
+  std::vector<Node> nodes;
+  // the deletion index: an open-addressing table of (hash of a variant << 32 | node), 0 if empty
+  std::vector<uint64_t> variants;
+  size_t variantCount = 0;
+
+  /**
+   * Files the given node under the given variant (its name or a one-char deletion of it).
+   */
+  void addVariant(const std::string & variant, uint32_t node);
+  /**
+   * Adds every node filed under the given variant to found.
+   */
+  void findVariant(const std::string & variant, std::set<uint32_t> & found) const;
+  std::set<std::string> names;
+  std::map<std::string, struct timespec> dirs; // dirs scanned, and their mtime when scanned
+ public:
+  /**
+   * Adds the given name to the index, if it isn't there already.
+   *
+   * @param const std::string& the command name
+   */
+  void add(const std::string &);
+  /**
+   * Adds the executables of every dir in the given search path that hasn't been scanned
+   * since it last changed.
+   *
+   * @param const std::string& the search path (e.g., $PATH)
+   */
+  void refresh(const std::string &);
+  /**
+   * Finds the names closest to the given one, within the given edit distance. A swap of two
+   * adjacent characters counts as one edit.
+   *
+   * @param const std::string& the name to look up
+   * @param unsigned int the largest edit distance to accept
+   * @return the matching names, closest first (ties in name order)
+   */
+  std::vector<std::string> suggest(const std::string &, unsigned int) const;
+  /**
+   * Gets the number of names in the index.
+   *
+   * @return the number of names
+   */
+  size_t size() const { return nodes.size(); }
+  /**
+   * Computes the edit distance between two strings: the fewest insertions, deletions,
+   * substitutions and transpositions of adjacent characters that turn one into the other.
+   *
+   * @return the edit distance
+   */
+  static unsigned int distance(const std::string &, const std::string &);
+
+}; // CommandIndex
+
+#endif
@@ -0,0 +1,248 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "Digest.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * Formats the given value as 2 * bytes lowercase hex digits.
+ */
+static string to_hex(uint64_t value, int bytes) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%0*llx", bytes * 2, (unsigned long long) value);
+  return buf;
+} // to_hex
+
+// _______________ crc32c ______________ //
+
+class Crc32c : public Digest {
+ private:
+  static uint32_t table[256];
+  uint32_t crc = 0xFFFFFFFF;
+  bool hardware;
+
+  /**
+   * Updates with the table, one byte at a time.
+   */
+  void updateTable(const unsigned char * p, size_t len) {
+    for(size_t i = 0; i < len; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  } // updateTable
+#if defined(__x86_64__)
+  /**
+   * Updates with the SSE4.2 crc32 instruction, 8 bytes at a time.
+   */
+  __attribute__((target("sse4.2"))) void updateHardware(const unsigned char * p, size_t len) {
+    uint64_t c = crc;
+    for(; len >= 8; p += 8, len -= 8) {
+      uint64_t word;
+      memcpy(&word, p, 8);
+      c = _mm_crc32_u64(c, word);
+    } // for
+    uint32_t c32 = (uint32_t) c;
+    for(; len > 0; p++, len--) c32 = _mm_crc32_u8(c32, *p);
+    crc = c32;
+  } // updateHardware
+#endif
+ protected:
+  void update(const char * data, size_t len) {
+#if defined(__x86_64__)
+    if(hardware) {
+      updateHardware((const unsigned char *) data, len);
+      return;
+    } // if
+#endif
+    updateTable((const unsigned char *) data, len);
+  } // update
+ public:
+  Crc32c() {
+#if defined(__x86_64__)
+    hardware = __builtin_cpu_supports("sse4.2");
+#else
+    hardware = false;
+#endif
+    if(table[1] == 0) {
+      for(uint32_t i = 0; i < 256; i++) {
+	uint32_t c = i;
+	for(int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1; // Castagnoli, reflected
+	table[i] = c;
+      } // for
+    } // if
+  } // Crc32c
+  const char * name() const { return "crc32c"; }
+  string hex() const { return to_hex(crc ^ 0xFFFFFFFF, 4); }
+}; // Crc32c
+
+uint32_t Crc32c::table[256];
+
+// _______________ sha256 ______________ //
+
+class Sha256 : public Digest {
+ private:
+  static const uint32_t K[64];
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  unsigned char block[64];
+  size_t blockLen = 0;
+  uint64_t total = 0;
+
+  static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  /**
+   * Compresses one 64-byte block into the state.
+   */
+  static void compress(uint32_t state[8], const unsigned char * p) {
+    uint32_t w[64];
+    for(int i = 0; i < 16; i++) {
+      w[i] = (uint32_t) p[4*i] << 24 | (uint32_t) p[4*i+1] << 16 | (uint32_t) p[4*i+2] << 8 | p[4*i+3];
+    } // for
+    for(int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+      uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    } // for
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], hh = state[7];
+    for(int i = 0; i < 64; i++) {
+      uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      hh = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    } // for
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += hh;
+  } // compress
+ protected:
+  void update(const char * data, size_t len) {
+    const unsigned char * p = (const unsigned char *) data;
+    total += len;
+    if(blockLen > 0) {
+      size_t n = (len < 64 - blockLen) ? len : 64 - blockLen;
+      memcpy(block + blockLen, p, n);
+      blockLen += n;
+      p += n;
+      len -= n;
+      if(blockLen < 64) return;
+      compress(h, block);
+      blockLen = 0;
+    } // if
+    for(; len >= 64; p += 64, len -= 64) compress(h, p);
+    memcpy(block, p, len);
+    blockLen = len;
+  } // update
+ public:
+  const char * name() const { return "sha256"; }
+  string hex() const {
+    // pads a copy, so more bytes could still be added
+    uint32_t state[8];
+    memcpy(state, h, sizeof(state));
+    unsigned char tail[128] = {0};
+    memcpy(tail, block, blockLen);
+    tail[blockLen] = 0x80;
+    size_t tailLen = (blockLen < 56) ? 64 : 128;
+    uint64_t bits = total * 8;
+    for(int i = 0; i < 8; i++) tail[tailLen - 1 - i] = (unsigned char) (bits >> (8 * i));
+    compress(state, tail);
+    if(tailLen == 128) compress(state, tail + 64);
+    string out;
+    for(int i = 0; i < 8; i++) out += to_hex(state[i], 4);
+    return out;
+  } // hex
+}; // Sha256
+
+const uint32_t Sha256::K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// _______________ xxh64 ______________ //
+
+class Xxh64 : public Digest {
+ private:
+  static const uint64_t P1 = 11400714785074694791ULL;
+  static const uint64_t P2 = 14029467366897019727ULL;
+  static const uint64_t P3 = 1609587929392839161ULL;
+  static const uint64_t P4 = 9650029242287828579ULL;
+  static const uint64_t P5 = 2870177450012600261ULL;
+  uint64_t v[4] = {P1 + P2, P2, 0, 0 - P1};
+  unsigned char stripe[32];
+  size_t stripeLen = 0;
+  uint64_t total = 0;
+
+  static uint64_t rotl(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+  static uint64_t read64(const unsigned char * p) { uint64_t x; memcpy(&x, p, 8); return x; }
+  static uint32_t read32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return x; }
+  static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+  static uint64_t merge(uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * P1 + P4; }
+
+  /**
+   * Consumes one 32-byte stripe.
+   */
+  void consume(const unsigned char * p) {
+    for(int i = 0; i < 4; i++) v[i] = round(v[i], read64(p + 8 * i));
+  } // consume
+ protected:
+  void update(const char * data, size_t len) {
+    const unsigned char * p = (const unsigned char *) data;
+    total += len;
+    if(stripeLen > 0) {
+      size_t n = (len < 32 - stripeLen) ? len : 32 - stripeLen;
+      memcpy(stripe + stripeLen, p, n);
+      stripeLen += n;
+      p += n;
+      len -= n;
+      if(stripeLen < 32) return;
+      consume(stripe);
+      stripeLen = 0;
+    } // if
+    for(; len >= 32; p += 32, len -= 32) consume(p);
+    memcpy(stripe, p, len);
+    stripeLen = len;
+  } // update
+ public:
+  const char * name() const { return "xxh64"; }
+  string hex() const {
+    uint64_t h;
+    if(total >= 32) {
+      h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+      for(int i = 0; i < 4; i++) h = merge(h, v[i]);
+    } else {
+      h = P5; // seed 0
+    } // if/else
+    h += total;
+    const unsigned char * p = stripe;
+    size_t len = stripeLen;
+    for(; len >= 8; p += 8, len -= 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if(len >= 4) {
+      h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+      p += 4;
+      len -= 4;
+    } // if
+    for(; len > 0; p++, len--) h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return to_hex(h, 8);
+  } // hex
+}; // Xxh64
+
+//_____________ create(const string&) _____________ //
+
+Digest * Digest::create(const string & name) {
+  if(name == "crc32c") return new Crc32c();
+  if(name == "sha256") return new Sha256();
+  if(name == "xxh64") return new Xxh64();
+  return nullptr;
+} // create
@@ -0,0 +1,50 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <string>
+#include "Relay.h"
+
+/**
+ * A checksum computed over the bytes flowing through a relay, without changing them. Used
+ * by checksum redirects ('>#ALG FILE'), so the digest of a job's output costs no second
+ * pass over the file.
+ */
+class Digest : public RelayFilter {
+ protected:
+  /**
+   * Adds the given bytes to the digest.
+   *
+   * @param data the bytes
+   * @param len the number of bytes
+   */
+  virtual void update(const char * data, size_t len) = 0;
+ public:
+  bool filter(const char * data, size_t len, std::string & out) {
+    update(data, len);
+    return false;
+  } // filter
+  /**
+   * Gets the name of the algorithm.
+   *
+   * @return the name, as accepted by create()
+   */
+  virtual const char * name() const = 0;
+  /**
+   * Gets the digest of every byte seen so far, in lowercase hex (as printed by sha256sum,
+   * xxh64sum and the like).
+   *
+   * @return the digest
+   */
+  virtual std::string hex() const = 0;
+  /**
+   * Creates a digest by name: "crc32c" (using the SSE4.2 crc32 instruction when the CPU has
+   * it), "sha256" or "xxh64".
+   *
+   * @param name the name of the algorithm
+   * @return the dynamically allocated digest, which must be deleted, or nullptr if the name
+   *         is unknown
+   */
+  static Digest * create(const std::string & name);
+}; // Digest
+
+#endif
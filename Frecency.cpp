@@ -0,0 +1,255 @@
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Frecency.h"
+
+using namespace std;
+
+// on-disk layout: a header followed by count packed records of
+// [float rank][uint32_t lastAccess][uint16_t len][char path[len]]
+struct FrecencyHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+}; // FrecencyHeader
+
+static const char FRECENCY_MAGIC[4] = {'1','7','F','R'};
+static const uint32_t FRECENCY_VERSION = 1;
+static const size_t RECORD_FIXED = sizeof(float) + sizeof(uint32_t) + sizeof(uint16_t);
+
+// ___________ constructors/destructors ____________ //
+
+Frecency::Frecency(string path) : dbPath(path) {
+  this->lastFlush = time(nullptr);
+} // constructor
+
+Frecency::~Frecency() {
+  unmapDB();
+} // destructor
+
+//_____________ mapDB() _____________ //
+
+void Frecency::mapDB() {
+  unmapDB();
+  int fd = open(dbPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd == -1) return;
+  struct stat sb;
+  if(fstat(fd, &sb) == 0 && (size_t) sb.st_size >= sizeof(FrecencyHeader)) {
+    void * addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr != MAP_FAILED) {
+      FrecencyHeader header;
+      memcpy(&header, addr, sizeof(header));
+      if(memcmp(header.magic, FRECENCY_MAGIC, 4) == 0 && header.version == FRECENCY_VERSION) {
+	dontfork(addr, sb.st_size); // children never need the index
+	this->db = (const char *) addr;
+	this->dbSize = sb.st_size;
+	this->dbCount = header.count;
+      } else {
+	munmap(addr, sb.st_size);
+      } // if/else
+    } // if
+  } // if
+  close(fd);
+} // mapDB
+
+//_____________ unmapDB() _____________ //
+
+void Frecency::unmapDB() {
+  if(db != nullptr) {
+    munmap((void *) db, dbSize);
+    this->db = nullptr;
+    this->dbSize = 0;
+    this->dbCount = 0;
+  } // if
+} // unmapDB
+
+//_____________ forEach(F) _____________ //
+
+template <typename F> void Frecency::forEach(F f) const {
+  vector<const Visit *> merged; // pending visits already added to an on-disk entry
+  if(db != nullptr) {
+    const char * p = db + sizeof(FrecencyHeader);
+    const char * end = db + dbSize;
+    string key; // reused, so pending-checks don't allocate per record
+    for(uint32_t i = 0; i < dbCount && p + RECORD_FIXED <= end; i++) {
+      float rank;
+      uint32_t lastAccess;
+      uint16_t len;
+      memcpy(&rank, p, sizeof(rank));
+      memcpy(&lastAccess, p + sizeof(float), sizeof(lastAccess));
+      memcpy(&len, p + sizeof(float) + sizeof(uint32_t), sizeof(len));
+      const char * path = p + RECORD_FIXED;
+      if(path + len > end) break; // truncated file
+      p = path + len;
+      if(!pending.empty()) {
+	auto it = pending.find(key.assign(path, len));
+	if(it != pending.end()) {
+	  if(it->second.forgotten) continue; // emitted below, without the on-disk rank
+	  merged.push_back(&it->second);
+	  rank += it->second.rank;
+	  lastAccess = max(lastAccess, it->second.lastAccess);
+	} // if
+      } // if
+      f(path, (size_t) len, rank, lastAccess);
+    } // for
+  } // if
+  for(auto it = pending.begin(); it != pending.end(); ++it) {
+    if(find(merged.begin(), merged.end(), &it->second) != merged.end()) continue;
+    f(it->first.data(), it->first.size(), it->second.rank, it->second.lastAccess);
+  } // for
+} // forEach
+
+//_____________ record(const string&) _____________ //
+
+void Frecency::record(const string & path) {
+  auto it = pending.find(path);
+  if(it == pending.end()) it = pending.emplace(arena_string(path.begin(), path.end()), Visit()).first;
+  it->second.rank += 1;
+  it->second.lastAccess = (uint32_t) time(nullptr);
+} // record
+
+//_____________ forget(const string&) _____________ //
+
+void Frecency::forget(const string & path) {
+  auto it = pending.find(path);
+  if(it == pending.end()) it = pending.emplace(arena_string(path.begin(), path.end()), Visit()).first;
+  it->second = Visit(); // a rank of 0 is dropped on flush
+  it->second.forgotten = true;
+} // forget
+
+//_____________ needsFlush() _____________ //
+
+bool Frecency::needsFlush() const {
+  if(pending.empty()) return false;
+  return pending.size() >= FLUSH_BATCH || time(nullptr) - lastFlush >= FLUSH_INTERVAL;
+} // needsFlush
+
+//_____________ flush() _____________ //
+
+int Frecency::flush() {
+  this->lastFlush = time(nullptr);
+  if(pending.empty()) return 0;
+  int lockFd = open((dbPath + ".lock").c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+  if(lockFd == -1) return -1;
+  int res;
+  while((res = flock(lockFd, LOCK_EX)) == -1 && errno == EINTR) {}
+  if(res == 0) res = merge();
+  close(lockFd); // releases the lock
+  return res;
+} // flush
+
+//_____________ merge() _____________ //
+
+int Frecency::merge() {
+  // merge against the latest file, since another shell may have flushed since we mapped it
+  mapDB();
+  vector<FrecencyEntry> entries;
+  entries.reserve(dbCount + pending.size());
+  float total = 0;
+  forEach([&entries, &total](const char * p, size_t len, float rank, uint32_t lastAccess) {
+      FrecencyEntry e;
+      e.path.assign(p, len);
+      e.rank = rank;
+      e.lastAccess = lastAccess;
+      total += rank;
+      entries.push_back(e);
+    });
+  float aging = (total > MAX_TOTAL_RANK) ? 0.99 : 1.0;
+  string buf;
+  buf.reserve(dbSize + pending.size() * 64);
+  FrecencyHeader header;
+  memcpy(header.magic, FRECENCY_MAGIC, 4);
+  header.version = FRECENCY_VERSION;
+  header.count = 0;
+  header.reserved = 0;
+  buf.append((const char *) &header, sizeof(header));
+  for(unsigned int i = 0; i < entries.size(); i++) {
+    float rank = entries[i].rank * aging;
+    if(rank < 1 || entries[i].path.size() > UINT16_MAX) continue; // aged out or forgotten
+    uint16_t len = entries[i].path.size();
+    buf.append((const char *) &rank, sizeof(rank));
+    buf.append((const char *) &entries[i].lastAccess, sizeof(uint32_t));
+    buf.append((const char *) &len, sizeof(len));
+    buf.append(entries[i].path);
+    header.count++;
+  } // for
+  memcpy(&buf[0], &header, sizeof(header));
+  // write to a temp file and rename it over the old db so readers never see a partial file
+  string tmp = dbPath + ".tmp." + to_string(getpid());
+  int fd = open(tmp.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+  if(fd == -1) return -1;
+  size_t off = 0;
+  while(off < buf.size()) {
+    ssize_t n = write(fd, buf.data() + off, buf.size() - off);
+    if(n == -1) {
+      close(fd);
+      unlink(tmp.c_str());
+      return -1;
+    } // if
+    off += n;
+  } // while
+  close(fd);
+  if(rename(tmp.c_str(), dbPath.c_str()) == -1) {
+    unlink(tmp.c_str());
+    return -1;
+  } // if
+  pending.clear();
+  mapDB();
+  return 0;
+} // merge
+
+//_____________ query(const vector<string>&) _____________ //
+
+vector<FrecencyEntry> Frecency::query(const vector<string> & terms) {
+  if(db == nullptr) mapDB();
+  uint32_t now = (uint32_t) time(nullptr);
+  vector<FrecencyEntry> matches;
+  for(int pass = 0; pass < 2 && matches.empty(); pass++) {
+    bool nocase = (pass == 1);
+    forEach([&](const char * p, size_t len, float rank, uint32_t lastAccess) {
+	if(rank <= 0) return;
+	// every term must appear in the path, in order
+	const char * cur = p;
+	const char * end = p + len;
+	for(unsigned int i = 0; i < terms.size(); i++) {
+	  const char * found;
+	  if(nocase) {
+	    found = search(cur, end, terms[i].begin(), terms[i].end(),
+			   [](char a, char b) { return tolower(a) == tolower(b); });
+	  } else {
+	    found = search(cur, end, terms[i].begin(), terms[i].end());
+	  } // if/else
+	  if(found == end && !terms[i].empty()) return;
+	  cur = found + terms[i].size();
+	} // for
+	// frecency: rank weighted by how recently the dir was visited
+	uint32_t dt = now - lastAccess;
+	float score = rank;
+	if(dt < 3600) {
+	  score *= 4;
+	} else if(dt < 86400) {
+	  score *= 2;
+	} else if(dt < 604800) {
+	  score /= 2;
+	} else {
+	  score /= 4;
+	} // if/else
+	FrecencyEntry e;
+	e.path.assign(p, len);
+	e.rank = score;
+	e.lastAccess = lastAccess;
+	matches.push_back(e);
+      });
+  } // for
+  sort(matches.begin(), matches.end(), [](const FrecencyEntry & a, const FrecencyEntry & b) {
+      return a.rank > b.rank;
+    });
+  return matches;
+} // query
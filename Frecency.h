@@ -0,0 +1,125 @@
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include "Arena.h"
+
+struct FrecencyEntry {
+  std::string path;
+  float rank = 0;
+  uint32_t lastAccess = 0;
+}; // FrecencyEntry
+
+class Frecency {
+ private:
+  // visits made in memory and not yet flushed, added to the on-disk rank (if any) when the
+  // two are merged; its path is the key it is stored under
+  struct Visit {
+    float rank = 0;
+    uint32_t lastAccess = 0;
+    bool forgotten = false; // the on-disk rank is dropped, not added to
+  }; // Visit
+  std::string dbPath;
+  const char * db = nullptr;
+  size_t dbSize = 0;
+  uint32_t dbCount = 0;
+  time_t lastFlush = 0;
+  // keys and all, lives in the cache arena, so forks don't copy it
+  std::map<arena_string, Visit, ArenaLess, ArenaAllocator<std::pair<const arena_string, Visit>>> pending;
+
+  /**
+   * Maps the database file into memory, replacing any previous mapping. A missing or
+   * corrupt database is treated as an empty one.
+   */
+  void mapDB();
+  /**
+   * Unmaps the database file, if it is mapped.
+   */
+  void unmapDB();
+  /**
+   * Calls the given function for every entry in the mapped database, followed by every
+   * entry that has only been recorded in memory. Visits recorded in memory are added to
+   * their on-disk counterparts, unless those were forgotten.
+   *
+   * @param F the function to call with (const char* path, size_t len, float rank, uint32_t lastAccess)
+   */
+  template <typename F> void forEach(F) const;
+  /**
+   * Merges the in-memory records with the latest database on disk and atomically replaces
+   * the database file. The caller must hold the database lock.
+   *
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int merge();
+ public:
+  /**
+   * Maximum number of in-memory records before a flush is due.
+   */
+  static const size_t FLUSH_BATCH = 32;
+  /**
+   * Maximum number of seconds an in-memory record may wait before a flush is due.
+   */
+  static const time_t FLUSH_INTERVAL = 60;
+  /**
+   * Once the total rank of all entries exceeds this, every rank is aged by 1%.
+   */
+  static constexpr float MAX_TOTAL_RANK = 9000;
+  /**
+   * Constructor. The database is not opened until it is first needed.
+   *
+   * @param string the path of the database file
+   */
+  Frecency(std::string);
+  /**
+   * Destructor. Unmaps the database. Does NOT flush.
+   */
+  ~Frecency();
+  /**
+   * Records a visit to the given directory. Only touches memory, and never reads the
+   * database; the record is merged into it by the next flush().
+   *
+   * @param const std::string& the absolute path of the directory visited
+   */
+  void record(const std::string &);
+  /**
+   * Removes the given directory from the index (on the next flush()).
+   *
+   * @param const std::string& the absolute path of the directory to forget
+   */
+  void forget(const std::string &);
+  /**
+   * Determines if enough records have piled up in memory to warrant a flush.
+   *
+   * @return true if flush() should be called, false if not
+   */
+  bool needsFlush() const;
+  /**
+   * Merges the in-memory records with the latest database on disk, ages the ranks if
+   * necessary, and atomically replaces the database file. Holds an flock() on the file
+   * DBPATH.lock throughout, so that shells flushing at once don't lose each other's visits.
+   *
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int flush();
+  /**
+   * Finds the directories whose path matches all of the given terms, in order, and sorts
+   * them by frecency (highest first). Matching is case-sensitive unless nothing matches.
+   *
+   * @param const std::vector<std::string>& the terms to match
+   * @return the matching entries, with rank replaced by the frecency score
+   */
+  std::vector<FrecencyEntry> query(const std::vector<std::string> &);
+  /**
+   * Gets the path of the database file.
+   *
+   * @return the path
+   */
+  const std::string & path() const { return dbPath; }
+
+}; // Frecency
+
+#endif
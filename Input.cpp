@@ -1,11 +1,29 @@
+#include <set>
 #include "Input.h"
+#include "SharedCache.h"
 
 using namespace std;
 
+map<string, vector<string>> aliases{};
+uint64_t alias_generation = 0;
+SharedCache * shared_cache = nullptr;
+
 // ___________ constructors/destructors ____________ //
   
 Input::Input(string input) {
   setShellInput(input); 
+  setTokens();
+  set_foreground();
+  setSTDIN();
+  setSTDOUT();
+  setSTDERR();
+  this->processes = inputToProcesses();
+} // constructor
+
+Input::Input(string input, const vector<string> & lexed) {
+  setShellInput(input);
+  this->tokens = lexed;
+  expandAliases(this->tokens);
   set_foreground();
   setSTDIN();
   setSTDOUT();
@@ -27,6 +45,39 @@ void Input::setShellInput(string input) {
   this->shellInput = input;
 } // setShellInput
 
+//_____________ setTokens() _____________ //
+
+void Input::setTokens() {
+  // a plan depends on the line and on the alias table it was expanded with. the table is
+  // hashed (not just numbered), since plans are shared with shells that have tables of
+  // their own, but only again once it has changed
+  static uint64_t stamp = 0;
+  static uint64_t stampGeneration = UINT64_MAX;
+  if(stampGeneration != alias_generation) {
+    stamp = fnv1a("plan/literal", 12); // the format of the plan: LITERAL marks tokens
+    for(auto it = aliases.begin(); it != aliases.end(); ++it) {
+      stamp = fnv1a(it->first.c_str(), it->first.size() + 1, stamp);
+      for(const string & token : it->second) stamp = fnv1a(token.c_str(), token.size() + 1, stamp);
+    } // for
+    stampGeneration = alias_generation;
+  } // if
+  string plan;
+  if(shared_cache != nullptr && shared_cache->get('P', this->shellInput, stamp, plan)) {
+    // the plan is every token followed by a NUL
+    this->tokens.clear();
+    for(size_t pos = 0, end; (end = plan.find('\0', pos)) != string::npos; pos = end + 1) {
+      this->tokens.push_back(plan.substr(pos, end - pos));
+    } // for
+    return;
+  } // if
+  this->tokens = lex(this->shellInput);
+  expandAliases(this->tokens);
+  if(shared_cache != nullptr) {
+    for(const string & token : this->tokens) plan.append(token.c_str(), token.size() + 1);
+    shared_cache->put('P', this->shellInput, stamp, plan);
+  } // if
+} // setTokens
+
 //_____________ set_foreground() _____________ //
 
 void Input::set_foreground() {
@@ -43,17 +94,11 @@ void Input::setStatus(const char * status) {
 
 void Input::setSTDIN() {
   string fd = "STDIN_FILENO";
-  stringstream ss(this->shellInput);
-  vector<string> argv;
-  string arg;
-  while(ss >> arg) {
-    argv.push_back(arg);
-  } // while
-  vector<string> processed_argv = processArgv(argv);
+  const vector<string> & processed_argv = this->tokens;
   for(unsigned int i = 0; i < processed_argv.size(); i++) {
     if(i > 0) {
       if(processed_argv[i-1] == "<") {
-	fd = processed_argv[i];
+	fd = unmark(processed_argv[i]);
 	break;
       } // if
     } // if 
@@ -66,17 +111,11 @@ void Input::setSTDIN() {
 void Input::setSTDOUT() {
   string fd = "STDOUT_FILENO";
   string type = "";
-  stringstream ss(this->shellInput);
-  vector<string> argv;
-  string arg;
-  while(ss >> arg) {
-    argv.push_back(arg);
-  } // while
-  vector<string> processed_argv = processArgv(argv);
+  const vector<string> & processed_argv = this->tokens;
   for(unsigned int i = 0; i < processed_argv.size(); i++) {
     if(i > 0) {
-      if(processed_argv[i-1] == ">>" || processed_argv[i-1] == ">") {
-	fd = processed_argv[i];
+      if(redirectOp(processed_argv[i-1]) == ">>" || redirectOp(processed_argv[i-1]) == ">") {
+	fd = unmark(processed_argv[i]);
 	type = processed_argv[i-1];
 	break;
       } // if
@@ -91,17 +130,11 @@ void Input::setSTDOUT() {
 void Input::setSTDERR() {
   string fd = "STDERR_FILENO";
   string type = "";
-  stringstream ss(this->shellInput);
-  vector<string> argv;
-  string arg;
-  while(ss >> arg) {
-    argv.push_back(arg);
-  } // while
-  vector<string> processed_argv = processArgv(argv);
+  const vector<string> & processed_argv = this->tokens;
   for(unsigned int i = 0; i < processed_argv.size(); i++) {
     if(i > 0) {
-      if(processed_argv[i-1] == "e>" || processed_argv[i-1] == "e>>") {
-	fd = processed_argv[i];
+      if(redirectOp(processed_argv[i-1]) == "e>" || redirectOp(processed_argv[i-1]) == "e>>") {
+	fd = unmark(processed_argv[i]);
 	type = processed_argv[i-1];
 	break;
       } // if
@@ -166,35 +199,24 @@ vector<Process> Input::inputToProcesses() {
   vector<Process> p_vector;
   // if empty
   if(this->shellInput.length() == 0) { return p_vector; } // if
-  // splits up original shell input
-  stringstream ss(this->shellInput);
-  vector<string> argv;
-  string a;
-  while(ss >> a) { 
-    argv.push_back(a);
-  } // while
-  // deals with double-quotes
-  vector<string> processed_argv = processArgv(argv);
+  // shell input was already split up, with double-quotes dealt with, by setTokens()
+  const vector<string> & processed_argv = this->tokens;
   // finally, add trimmed, concatenated/processed, and sanitized args to p_vector
   for(unsigned int i = 0; i < processed_argv.size(); i++) {
     if(i == 0) { 
       Process p;
       p_vector.push_back(p); // create a new Process
-      p_vector[i].args.push_back(processed_argv[i]); // push the name of the process to be the first argument of the Process vector<string>
+      p_vector[i].args.push_back(unmark(processed_argv[i])); // push the name of the process to be the first argument of the Process vector<string>
     } else if(processed_argv[i-1] == "|") { 
       Process p;
       p_vector.push_back(p); // create a new Process
-      p_vector.back().args.push_back(processed_argv[i]); // push the name of the process to be the first argument of the Process vector<string>	
+      p_vector.back().args.push_back(unmark(processed_argv[i])); // push the name of the process to be the first argument of the Process vector<string>	
     } else { 
-      if(processed_argv[i] != "<" && processed_argv[i-1] != "<" &&
-	 processed_argv[i] != ">" && processed_argv[i-1] != ">" &&
-	 processed_argv[i] != ">>" && processed_argv[i-1] != ">>" &&
-	 processed_argv[i] != "e>" && processed_argv[i-1] != "e>" &&
-	 processed_argv[i] != "e>>" && processed_argv[i-1] != "e>>") {
+      if(redirectOp(processed_argv[i]) == "" && redirectOp(processed_argv[i-1]) == "") {
 	if(processed_argv[i] == "|") {
 	  p_vector.back().hasPipe = true;
 	} else if(processed_argv[i] != "&") {
-	  p_vector.back().args.push_back(processed_argv[i]); // push the process arguments to the Process vector<string>
+	  p_vector.back().args.push_back(unmark(processed_argv[i])); // push the process arguments to the Process vector<string>
 	} // if/else
       } // if
     } // if/else
@@ -208,6 +230,7 @@ vector<Process> Input::inputToProcesses() {
 
 Input& Input::operator=(string input) {
   setShellInput(input); 
+  setTokens();
   set_foreground();
   setSTDIN();
   setSTDOUT();
@@ -253,6 +276,17 @@ string sanitize(string input, string charsToRemove) {
   return sanitized_str;
 } // sanitize
 
+string redirectOp(const string & token) {
+  string op = token;
+  if(token.size() > 1 && (token[0] == '>' || token[0] == 'e')) op = token.substr(0, token.find_first_of("#@"));
+  if(op == "<" || op == ">" || op == ">>" || op == "e>" || op == "e>>") return op;
+  return "";
+} // redirectOp
+
+string unmark(const string & token) {
+  return (!token.empty() && token[0] == LITERAL) ? token.substr(1) : token;
+} // unmark
+
 bool hasQuotes(string input) {
   for(unsigned int i = 0; i < input.length(); i++) {
     if(i == 0) {
@@ -307,6 +341,8 @@ vector<string> processArgv(vector<string> argv) {
       } // if/else
     } // if/else
     arg = trim(arg);
+    // a quoted or escaped word is never an operator
+    bool literal = (arg.find_first_of("\"\\") != string::npos);
     // remove beginning/end quotes
     string proc_arg = "";
     for(unsigned int i = 0; i < arg.length(); i++) {
@@ -319,8 +355,68 @@ vector<string> processArgv(vector<string> argv) {
       } // if/else
     } // for
     proc_arg = sanitize(proc_arg,"\\");
-    processed_argv.push_back(proc_arg);
+    processed_argv.push_back((literal) ? LITERAL + proc_arg : proc_arg);
   } // for
   return processed_argv;
 } // processArgv
 
+uint64_t fnv1a(const char * data, size_t len, uint64_t seed) {
+  uint64_t hash = seed;
+  for(size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ULL;
+  } // for
+  return hash;
+} // fnv1a
+
+vector<string> lex(string input) {
+  stringstream ss(input);
+  vector<string> argv;
+  string arg;
+  while(ss >> arg) {
+    argv.push_back(arg);
+  } // while
+  return processArgv(argv);
+} // lex
+
+// _______________ aliases ______________ //
+
+/**
+ * Appends the given word to out, or, if it names an alias not in seen, the alias's expansion.
+ */
+static void spliceAlias(const string & word, vector<string> & out, set<string> & seen) {
+  auto it = aliases.find(word);
+  if(it == aliases.end() || seen.count(word) != 0) {
+    out.push_back(word);
+    return;
+  } // if
+  seen.insert(word);
+  bool cmdPos = true;
+  for(const string & token : it->second) {
+    if(cmdPos) {
+      spliceAlias(token, out, seen);
+    } else {
+      out.push_back(token);
+    } // if/else
+    cmdPos = (token == "|");
+  } // for
+  seen.erase(word);
+} // spliceAlias
+
+void expandAliases(vector<string> & tokens) {
+  if(aliases.empty()) return;
+  vector<string> expanded;
+  expanded.reserve(tokens.size());
+  set<string> seen;
+  bool cmdPos = true;
+  for(unsigned int i = 0; i < tokens.size(); i++) {
+    if(cmdPos) {
+      spliceAlias(tokens[i], expanded, seen);
+    } else {
+      expanded.push_back(tokens[i]);
+    } // if/else
+    cmdPos = (tokens[i] == "|");
+  } // for
+  tokens.swap(expanded);
+} // expandAliases
+
@@ -1,11 +1,13 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <sstream>
+#include <map>
 
 struct Process {
   pid_t PID = -1;
@@ -22,6 +24,7 @@ class Input {
   bool foreground;
   const char * status = "Running";
   std::string shellInput;
+  std::vector<std::string> tokens;
   std::vector<Process> processes;
   std::string fd_STDIN;
   std::string fd_STDOUT;
@@ -35,6 +38,11 @@ class Input {
    * @param string the shell input string
    */
   void setShellInput(std::string);
+  /**
+   * Called in constructor. Lexes the shellInput member into tokens, once, and splices in
+   * the expansion of any alias found at a command position.
+   */
+  void setTokens();
   /**
    * Called in constructor. Converts the shellInput member into a vector<Process>.
    *
@@ -67,6 +75,14 @@ class Input {
    * @param string the shell input from the user
    */
   Input(std::string); 
+  /**
+   * Constructor for shell input that has already been lexed (e.g., ahead of time, by a
+   * Lookahead). Aliases are expanded here, with the alias table as it is now.
+   *
+   * @param std::string the shell input from the user
+   * @param const std::vector<std::string>& the lexed tokens of the shell input
+   */
+  Input(std::string, const std::vector<std::string> &);
   /**
    * Copy Constructor.
    *
@@ -79,6 +95,13 @@ class Input {
    * @param pid_t the pid of the first Process in the job
    */
   void setJID(pid_t);
+  /**
+   * Sets the destination for the job's STDIN. Used when a pipeline rewrite turns a leading
+   * 'cat FILE |' into '< FILE'.
+   *
+   * @param std::string the STDIN destination
+   */
+  void setSTDIN_fd(std::string fd) { this->fd_STDIN = fd; }
   /**
    * Sets the status of the current job for bookkeeping purposes. Can be either "Running" or "Stopped."
    *
@@ -109,6 +132,12 @@ class Input {
    * @return std::string& the shell input string
    */
   const std::string& getShellInput() const { return shellInput; } 
+  /**
+   * Gets the lexed, alias-expanded tokens of the shell input.
+   *
+   * @return std::vector<std::string>& the tokens
+   */
+  const std::vector<std::string>& getTokens() const { return tokens; }
   /**
    * Gets the destination for the job's STDIN.
    *
@@ -192,6 +221,40 @@ class Input {
  */
 std::ostream& operator<<(std::ostream& output, Input& rhs);
 
+// ___________________ Shared cache _____________________ //
+
+class SharedCache;
+
+/**
+ * The cache shared by all shell instances, or nullptr if it is unavailable. Lexed,
+ * alias-expanded lines ("plans") are stored in it, so that every instance benefits from
+ * the first one to run a script.
+ */
+extern SharedCache * shared_cache;
+
+// ___________________ Aliases _____________________ //
+
+/**
+ * The alias table. Maps each alias name to its expansion, which is lexed once (when the
+ * alias is defined) so that it can be spliced straight into the token stream.
+ */
+extern std::map<std::string, std::vector<std::string>> aliases;
+
+/**
+ * Incremented on every change to the alias table, so that the stamp plans are cached under
+ * is only recomputed when the table has changed.
+ */
+extern uint64_t alias_generation;
+
+/**
+ * Splices the expansion of every alias found at a command position (the first token, or
+ * the token after a pipe) into the given tokens. The first word of an expansion is itself
+ * expanded, unless it names an alias already being expanded.
+ *
+ * @param std::vector<std::string>& the tokens to expand in place
+ */
+void expandAliases(std::vector<std::string>&);
+
 // ___________________ Non-member helper methods _____________________ //
 
 /**
@@ -210,6 +273,30 @@ std::string trim(std::string);
  */
 std::string sanitize(std::string input, std::string charsToRemove);
 
+/**
+ * Gets the plain operator of a redirect token (<, >, >>, e> or e>>), without the checksum or
+ * timestamp modifier an output redirect may carry (e.g., ">#sha256=SUM" and ">@mono" give ">").
+ *
+ * @param const std::string& the token
+ * @return the operator, or "" if the token is not a redirect
+ */
+std::string redirectOp(const std::string &);
+
+/**
+ * Marks a token as literal: a word that was quoted or escaped, or that came from the output
+ * of a command substitution. A literal token is never taken for an operator, a redirect or
+ * an alias, whatever it contains. The mark is dropped from the args and files of the job.
+ */
+const char LITERAL = '\x1f';
+
+/**
+ * Gets the given token without its LITERAL mark, if it has one.
+ *
+ * @param const std::string& the token
+ * @return the token as the job sees it
+ */
+std::string unmark(const std::string &);
+
 /**
  * Determines if shell input has any unescaped double-quotes.
  *
@@ -229,12 +316,32 @@ unsigned int pos_of_first_quote(std::string);
 /**
  * Processes the raw argv vector<string> obtained from the stringstream
  * of the shell input. Deals with the double-quotes, trims each argument,
- * and sanitizes the backslashes.
+ * and sanitizes the backslashes. Arguments that were quoted or escaped are marked LITERAL.
  *
  * @param std::vector<string> the unprocessed args from the stringstream
  * @return the processed vector<string> used to determine i/o destinations/populate the vector<Process>
  */
 std::vector<std::string> processArgv(std::vector<std::string>);
 
+/**
+ * Lexes the given shell input into tokens: splits it on whitespace and processes the
+ * result with processArgv().
+ *
+ * @param std::string the shell input to lex
+ * @return the tokens
+ */
+std::vector<std::string> lex(std::string);
+
+/**
+ * Computes the 64-bit FNV-1a hash of the given bytes. Used to validate cached state
+ * (snapshots, journals, shared caches) against the input it was derived from.
+ *
+ * @param data the bytes to hash
+ * @param len the number of bytes
+ * @param seed the starting hash value, so that hashes can be chained
+ * @return the hash
+ */
+uint64_t fnv1a(const char * data, size_t len, uint64_t seed = 14695981039346656037ULL);
+
 #endif
 
@@ -0,0 +1,108 @@
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "Journal.h"
+
+using namespace std;
+
+static const char * JOURNAL_MAGIC = "1730sh-journal 1";
+
+// ___________ constructors/destructors ____________ //
+
+Journal::Journal(string path) : path(path) {} // constructor
+
+Journal::~Journal() {
+  if(fd != -1) {
+    sync();
+    close(fd);
+  } // if
+} // destructor
+
+//_____________ open(uint64_t, bool) _____________ //
+
+int Journal::open(uint64_t scriptHash, bool resume) {
+  char header[64];
+  snprintf(header, sizeof(header), "%s %016" PRIx64 "\n", JOURNAL_MAGIC, scriptHash);
+  this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(fd == -1) return -1;
+  int res = 0;
+  off_t good = 0; // end of the last complete record
+  if(resume) {
+    struct stat sb;
+    if(fstat(fd, &sb) == -1) return fail();
+    string contents(sb.st_size, '\0');
+    if(sb.st_size > 0 && pread(fd, &contents[0], sb.st_size, 0) != sb.st_size) return fail();
+    if(contents.compare(0, strlen(header), header) == 0) {
+      good = strlen(header);
+      for(size_t end; (end = contents.find('\n', good)) != string::npos; good = end + 1) {
+	unsigned int line;
+	uint64_t hash;
+	int len = 0;
+	if(sscanf(contents.c_str() + good, "%u %" SCNx64 "%n", &line, &hash, &len) != 2) break;
+	size_t dir = good + len + 1; // past the space, if there is a DIR
+	done[make_pair(line, hash)] = (dir < end) ? contents.substr(dir, end - dir) : "";
+      } // for
+    } else if(sb.st_size > 0) {
+      res = 1;
+    } // if/else
+  } // if
+  // drops a torn record (or a stale journal), then writes a header if starting over
+  if(ftruncate(fd, good) == -1 || lseek(fd, good, SEEK_SET) == -1) return fail();
+  if(good == 0) {
+    if(write(fd, header, strlen(header)) != (ssize_t) strlen(header) || fdatasync(fd) == -1) return fail();
+  } // if
+  this->lastSync = time(nullptr);
+  return res;
+} // open
+
+//_____________ fail() _____________ //
+
+int Journal::fail() {
+  int err = errno;
+  close(fd);
+  this->fd = -1;
+  errno = err;
+  return -1;
+} // fail
+
+//_____________ isDone(unsigned int, uint64_t) _____________ //
+
+bool Journal::isDone(unsigned int line, uint64_t hash) const {
+  return done.count(make_pair(line, hash)) != 0;
+} // isDone
+
+//_____________ directory(unsigned int, uint64_t) _____________ //
+
+string Journal::directory(unsigned int line, uint64_t hash) const {
+  auto it = done.find(make_pair(line, hash));
+  return (it != done.end()) ? it->second : "";
+} // directory
+
+//_____________ record(unsigned int, uint64_t, const string&) _____________ //
+
+int Journal::record(unsigned int line, uint64_t hash, const string & dir) {
+  char fixed[48];
+  snprintf(fixed, sizeof(fixed), "%u %016" PRIx64, line, hash);
+  // a DIR with a newline in it can't be journaled, so that command is simply rerun
+  string rec = (dir == "" || dir.find('\n') != string::npos) ? string(fixed) : string(fixed) + " " + dir;
+  rec += '\n';
+  // a single write, so a record is never interleaved
+  if(write(fd, rec.data(), rec.size()) != (ssize_t) rec.size()) return -1;
+  this->unsynced++;
+  if(unsynced >= SYNC_BATCH || time(nullptr) - lastSync >= SYNC_INTERVAL) return sync();
+  return 0;
+} // record
+
+//_____________ sync() _____________ //
+
+int Journal::sync() {
+  this->lastSync = time(nullptr);
+  if(unsynced == 0) return 0;
+  this->unsynced = 0;
+  return fdatasync(fd);
+} // sync
@@ -0,0 +1,100 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+
+/**
+ * A progress journal for a script run with --journal. Records each top-level command that
+ * completed successfully, so that a rerun with --resume can skip them.
+ *
+ * The journal is a text file: a header line with the hash of the script, followed by one
+ * "LINE HASH" line per completed command, or "LINE HASH DIR" for a command (like 'z') whose
+ * destination directory can't be worked out again on resume. Records are appended as soon as a command
+ * completes, so they survive the shell being killed, but are only fdatasync()ed every
+ * SYNC_BATCH records or SYNC_INTERVAL seconds, so a long script isn't slowed by a sync per
+ * command. After a power loss, at most the unsynced records are lost (and rerun).
+ */
+class Journal {
+ private:
+  std::string path;
+  int fd = -1;
+  std::map<std::pair<unsigned int, uint64_t>, std::string> done; // the DIR of each record, if any
+  size_t unsynced = 0;
+  time_t lastSync = 0;
+
+  /**
+   * Closes the journal file after a failure in open(), keeping errno.
+   *
+   * @return -1
+   */
+  int fail();
+ public:
+  /**
+   * Maximum number of records appended before a sync.
+   */
+  static const size_t SYNC_BATCH = 32;
+  /**
+   * Maximum number of seconds a record may wait before a sync.
+   */
+  static const time_t SYNC_INTERVAL = 2;
+  /**
+   * Constructor. The journal is not opened until open() is called.
+   *
+   * @param std::string the path of the journal file
+   */
+  Journal(std::string);
+  /**
+   * Destructor. Syncs and closes the journal.
+   */
+  ~Journal();
+  /**
+   * Opens the journal for the script with the given hash. When resuming, the records of a
+   * journal written for the same script are loaded (a torn last record is discarded) and
+   * appended to. Otherwise, or if the journal was written for a different script, it is
+   * started over.
+   *
+   * @param scriptHash the hash of the script's contents
+   * @param resume true if the journal's records should be kept
+   * @return -1 upon any system call failure, 1 if an existing journal was for a different
+   *         script and was started over, 0 otherwise
+   */
+  int open(uint64_t scriptHash, bool resume);
+  /**
+   * Determines if the command with the given line number and hash was journaled.
+   *
+   * @param line the line on which the command starts
+   * @param hash the hash of the command
+   * @return true if it completed on a previous run, false if not
+   */
+  bool isDone(unsigned int line, uint64_t hash) const;
+  /**
+   * Gets the directory journaled with the command with the given line number and hash.
+   *
+   * @param line the line on which the command starts
+   * @param hash the hash of the command
+   * @return the directory, or "" if none was journaled
+   */
+  std::string directory(unsigned int line, uint64_t hash) const;
+  /**
+   * Appends a record for a command that completed successfully, syncing if one is due.
+   *
+   * @param line the line on which the command starts
+   * @param hash the hash of the command
+   * @param dir the directory the command went to, if it must be journaled, or ""
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int record(unsigned int line, uint64_t hash, const std::string & dir = "");
+  /**
+   * Syncs the appended records to disk.
+   *
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int sync();
+
+}; // Journal
+
+#endif
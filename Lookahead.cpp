@@ -0,0 +1,83 @@
+
+#include <climits>
+#include <csignal>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "Lookahead.h"
+
+using namespace std;
+
+/**
+ * Sleeps until woken, as long as the given word still holds the given value.
+ */
+static void futex_wait(atomic<uint32_t> & word, uint32_t value) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+} // futex_wait
+
+/**
+ * Wakes every thread sleeping on the given word.
+ */
+static void futex_wake(atomic<uint32_t> & word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+} // futex_wake
+
+// ___________ constructors/destructors ____________ //
+
+Lookahead::Lookahead(function<bool(ScriptLine &)> produce): produce(produce) {
+  // signals are the main thread's to handle
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  this->worker = thread(&Lookahead::run, this);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+} // constructor
+
+Lookahead::~Lookahead() {
+  this->stopping = true;
+  this->producerSeq++;
+  futex_wake(this->producerSeq);
+  this->worker.join();
+} // destructor
+
+//_____________ run() _____________ //
+
+void Lookahead::run() {
+  bool more = true;
+  while(more && !this->stopping) {
+    uint32_t t = this->tail.load(memory_order_relaxed);
+    // waits while DEPTH commands are already waiting to be run
+    while(t - this->head.load() >= DEPTH && !this->stopping) {
+      this->producerWaiting = true;
+      uint32_t seq = this->producerSeq.load(); // before the checks, so no wake is missed
+      if(t - this->head.load() >= DEPTH && !this->stopping) futex_wait(this->producerSeq, seq);
+    } // while
+    if(this->stopping) break;
+    ScriptLine & slot = this->ring[t % CAPACITY];
+    slot = ScriptLine();
+    more = this->produce(slot);
+    if(!more) slot = ScriptLine(); // the end marker
+    this->tail.store(t + 1); // publishes the slot
+    if(this->consumerWaiting.exchange(false)) futex_wake(this->tail);
+  } // while
+} // run
+
+//_____________ pop(ScriptLine&) _____________ //
+
+bool Lookahead::pop(ScriptLine & out) {
+  uint32_t h = this->head.load(memory_order_relaxed);
+  uint32_t t;
+  while((t = this->tail.load()) == h) {
+    this->consumerWaiting = true;
+    if(this->tail.load() == h) futex_wait(this->tail, t);
+  } // while
+  ScriptLine & slot = this->ring[h % CAPACITY];
+  if(slot.line == 0) return false; // stays at the end marker
+  out = std::move(slot);
+  this->head.store(h + 1); // hands the slot back
+  if(this->producerWaiting.exchange(false)) {
+    this->producerSeq++;
+    futex_wake(this->producerSeq);
+  } // if
+  return true;
+} // pop
@@ -0,0 +1,78 @@
+#ifndef LOOKAHEAD_H
+#define LOOKAHEAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A command of a script, read, lexed and validated ahead of time.
+ */
+struct ScriptLine {
+  unsigned int line = 0; // the line the command starts on. 0 marks the end of the script
+  std::string input;
+  bool valid = false; // whether input passed isValidInput()
+  std::vector<std::string> tokens; // lexed, but not yet alias-expanded
+  uint64_t hash = 0; // fnv1a() of input
+}; // ScriptLine
+
+/**
+ * Reads the commands of a script on a helper thread while the shell runs the ones before
+ * them, so parsing stays off the critical path of long scripts. Commands are handed over
+ * in order through a single-producer, single-consumer ring that needs no locks; a side that
+ * finds the ring empty (or full) sleeps on a futex until the other side moves on. The helper
+ * stays at most DEPTH commands ahead.
+ *
+ * The helper must not touch shell state that the shell may change while running a command
+ * (e.g., the alias table), so aliases are expanded by the consumer.
+ */
+class Lookahead {
+ private:
+  static const uint32_t CAPACITY = 64; // a power of two, more than DEPTH
+  ScriptLine ring[CAPACITY];
+  std::atomic<uint32_t> head{0}; // the next slot to pop. Only the consumer writes it
+  std::atomic<uint32_t> tail{0}; // the next slot to push. Only the producer writes it
+  std::atomic<bool> consumerWaiting{false};
+  std::atomic<bool> producerWaiting{false};
+  std::atomic<bool> stopping{false};
+  // what the producer sleeps on: bumped whenever it is woken (for a freed slot or to stop),
+  // so a wake that comes between its last check and its sleep still changes the word
+  std::atomic<uint32_t> producerSeq{0};
+  std::function<bool(ScriptLine &)> produce;
+  std::thread worker;
+
+  /**
+   * The helper thread's loop. Produces commands into the ring until produce() runs out of
+   * them (then pushes the end marker) or the consumer goes away.
+   */
+  void run();
+ public:
+  /**
+   * The most commands the helper reads ahead of the one being run.
+   */
+  static const uint32_t DEPTH = 32;
+  /**
+   * Constructor. Starts the helper thread, with every signal blocked.
+   *
+   * @param produce called on the helper thread to fill in the next command; returns false
+   * at the end of the script
+   */
+  Lookahead(std::function<bool(ScriptLine &)> produce);
+  /**
+   * Destructor. Stops and joins the helper thread.
+   */
+  ~Lookahead();
+  /**
+   * Takes the next command, waiting for the helper to produce it if necessary.
+   *
+   * @param ScriptLine& set to the next command
+   * @return false at the end of the script, true otherwise
+   */
+  bool pop(ScriptLine &);
+
+}; // Lookahead
+
+#endif
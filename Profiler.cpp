@@ -0,0 +1,148 @@
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include "Profiler.h"
+
+using namespace std;
+
+/**
+ * Gets the user + sys seconds in the given rusage.
+ */
+static double cpu_seconds(const struct rusage & ru) {
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+} // cpu_seconds
+
+/**
+ * Makes the given text safe to use as a folded stack frame.
+ */
+static string frame(string text) {
+  replace(text.begin(), text.end(), ';', ',');
+  replace(text.begin(), text.end(), '\n', ' ');
+  return text;
+} // frame
+
+// _______________ ProfileTimes ______________ //
+
+void ProfileTimes::add(const ProfileTimes & t) {
+  wall += t.wall;
+  childCpu += t.childCpu;
+  shellCpu += t.shellCpu;
+  parse += t.parse;
+  fork += t.fork;
+  count += t.count;
+} // add
+
+// ___________ constructors/destructors ____________ //
+
+Profiler::Profiler(string script) : script(script) {} // constructor
+
+//_____________ now() _____________ //
+
+double Profiler::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+} // now
+
+//_____________ begin(unsigned int, const string&) _____________ //
+
+void Profiler::begin(unsigned int line, const string & text) {
+  this->current = ProfileTimes();
+  this->currentLine = line;
+  this->currentText = text;
+  this->currentCommand = "";
+  getrusage(RUSAGE_SELF, &startSelf);
+  getrusage(RUSAGE_CHILDREN, &startChildren);
+  this->startWall = now();
+} // begin
+
+//_____________ addParse(double) _____________ //
+
+void Profiler::addParse(double seconds) {
+  current.parse += seconds;
+} // addParse
+
+//_____________ addFork(double) _____________ //
+
+void Profiler::addFork(double seconds) {
+  current.fork += seconds;
+} // addFork
+
+//_____________ setCommands(const vector<string>&) _____________ //
+
+void Profiler::setCommands(const vector<string> & names) {
+  this->currentCommand = "";
+  for(unsigned int i = 0; i < names.size(); i++) {
+    currentCommand += ((i == 0) ? "" : "|") + names[i];
+  } // for
+} // setCommands
+
+//_____________ end() _____________ //
+
+void Profiler::end() {
+  current.wall = now() - startWall;
+  struct rusage self, children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  current.shellCpu = cpu_seconds(self) - cpu_seconds(startSelf);
+  current.childCpu = cpu_seconds(children) - cpu_seconds(startChildren);
+  current.count = 1;
+  LineProfile & lp = lines[currentLine];
+  lp.text = currentText;
+  lp.times.add(current);
+  if(currentCommand == "") this->currentCommand = "(invalid)";
+  commands[currentCommand].add(current);
+} // end
+
+//_____________ report(ostream&, size_t) _____________ //
+
+void Profiler::report(ostream & out, size_t top) {
+  ProfileTimes total;
+  for(auto it = lines.begin(); it != lines.end(); ++it) total.add(it->second.times);
+  out << "1730sh: profile of " << script << ": " << total.count << " commands, " << fixed << setprecision(3)
+      << total.wall << "s wall, " << total.childCpu << "s child CPU, " << total.shellCpu << "s shell CPU" << endl;
+  // prints one row per entry, heaviest wall time first
+  auto table = [&out, top](const vector<pair<string, ProfileTimes>> & rows, const string & what) {
+    vector<pair<string, ProfileTimes>> sorted(rows);
+    sort(sorted.begin(), sorted.end(), [](const pair<string, ProfileTimes> & a, const pair<string, ProfileTimes> & b) {
+	return a.second.wall > b.second.wall;
+      });
+    out << endl << std::right << setw(10) << "wall(s)" << setw(10) << "child(s)" << setw(10) << "shell(s)"
+	<< setw(11) << "parse(ms)" << setw(10) << "fork(ms)" << setw(8) << "count" << "  " << what << endl;
+    for(size_t i = 0; i < sorted.size() && i < top; i++) {
+      const ProfileTimes & t = sorted[i].second;
+      out << fixed << setprecision(3) << setw(10) << t.wall << setw(10) << t.childCpu << setw(10) << t.shellCpu
+	  << setw(11) << t.parse * 1000 << setw(10) << t.fork * 1000 << setw(8) << t.count
+	  << "  " << sorted[i].first << endl;
+    } // for
+  };
+  vector<pair<string, ProfileTimes>> rows;
+  for(auto it = lines.begin(); it != lines.end(); ++it) {
+    rows.push_back(make_pair(to_string(it->first) + ": " + it->second.text, it->second.times));
+  } // for
+  table(rows, "line");
+  rows.clear();
+  for(auto it = commands.begin(); it != commands.end(); ++it) rows.push_back(*it);
+  table(rows, "command");
+} // report
+
+//_____________ writeFolded(const string&) _____________ //
+
+int Profiler::writeFolded(const string & path) {
+  ofstream out(path);
+  if(!out) return -1;
+  string base = frame(script.substr(script.find_last_of('/') + 1));
+  for(auto it = lines.begin(); it != lines.end(); ++it) {
+    const ProfileTimes & t = it->second.times;
+    string stack = base + ";" + to_string(it->first) + ": " + frame(it->second.text) + ";";
+    // the phases split the line's wall time, so frame widths add up to it
+    double run = max(0.0, t.wall - t.parse - t.fork);
+    if(t.parse > 0) out << stack << "parse " << (uint64_t) (t.parse * 1e6) << "\n";
+    if(t.fork > 0) out << stack << "fork " << (uint64_t) (t.fork * 1e6) << "\n";
+    out << stack << "run " << (uint64_t) (run * 1e6) << "\n";
+  } // for
+  out.close();
+  return (out.fail()) ? -1 : 0;
+} // writeFolded
@@ -0,0 +1,105 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+/**
+ * Times spent running a script line (or the sum over many), in seconds.
+ */
+struct ProfileTimes {
+  double wall = 0;      // from reading the line to the shell being ready for the next one
+  double childCpu = 0;  // user + sys of the children waited for
+  double shellCpu = 0;  // user + sys of the shell itself
+  double parse = 0;     // lexing, alias expansion and building the job
+  double fork = 0;      // in fork() (page table copies, etc.)
+  unsigned int count = 0;
+  void add(const ProfileTimes &);
+}; // ProfileTimes
+
+/**
+ * Profiles a script run with --profile. Each line's times are measured between begin() and
+ * end(), and aggregated both by line and by command name (the names of the commands in
+ * the line's pipeline, joined with '|').
+ */
+class Profiler {
+ private:
+  struct LineProfile {
+    std::string text;
+    ProfileTimes times;
+  }; // LineProfile
+  std::string script;
+  std::map<unsigned int, LineProfile> lines;
+  std::map<std::string, ProfileTimes> commands;
+  ProfileTimes current;
+  unsigned int currentLine = 0;
+  std::string currentText;
+  std::string currentCommand;
+  double startWall = 0;
+  struct rusage startSelf;
+  struct rusage startChildren;
+ public:
+  /**
+   * Constructor.
+   *
+   * @param std::string the path of the script being profiled
+   */
+  Profiler(std::string);
+  /**
+   * Starts profiling a script line.
+   *
+   * @param line the line number
+   * @param text the command on the line
+   */
+  void begin(unsigned int line, const std::string & text);
+  /**
+   * Adds time spent parsing the current line.
+   *
+   * @param double seconds
+   */
+  void addParse(double);
+  /**
+   * Adds time spent in fork() for the current line.
+   *
+   * @param double seconds
+   */
+  void addFork(double);
+  /**
+   * Sets the name under which the current line is aggregated.
+   *
+   * @param const std::vector<std::string>& the names of the commands in its pipeline
+   */
+  void setCommands(const std::vector<std::string> &);
+  /**
+   * Stops profiling the current line and adds its times to the totals.
+   */
+  void end();
+  /**
+   * Prints the lines and the commands that took the most wall time.
+   *
+   * @param std::ostream& the stream to print to
+   * @param size_t how many of each to print
+   */
+  void report(std::ostream &, size_t);
+  /**
+   * Writes the profile as folded stacks ("script;LINE;PHASE MICROSECONDS" per line), which
+   * flame graph tools (e.g., flamegraph.pl) accept.
+   *
+   * @param const std::string& the path of the file to write
+   * @return -1 if the file couldn't be written, 0 otherwise
+   */
+  int writeFolded(const std::string &);
+  /**
+   * Gets the seconds elapsed on a monotonic clock.
+   *
+   * @return the seconds
+   */
+  static double now();
+
+}; // Profiler
+
+#endif
@@ -0,0 +1,243 @@
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "Prompt.h"
+
+using namespace std;
+
+/**
+ * Gets the value of a variable in the given environment.
+ */
+static string env_value(const vector<string> & env, const string & name) {
+  for(unsigned int i = 0; i < env.size(); i++) {
+    if(env[i].compare(0, name.size(), name) == 0 && env[i].size() > name.size() && env[i][name.size()] == '=') {
+      return env[i].substr(name.size() + 1);
+    } // if
+  } // for
+  return "";
+} // env_value
+
+// ___________ constructors/destructors ____________ //
+
+PromptSegments::PromptSegments(vector<string> env) : env(env) {
+  if(pipe2(notify, O_CLOEXEC | O_NONBLOCK) == -1) notify[0] = notify[1] = -1;
+  // signals are left to the main thread, which blocks some of them in event_wait()
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  this->worker = thread(&PromptSegments::run, this);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+} // constructor
+
+//_____________ isSegment(const string&) _____________ //
+
+bool PromptSegments::isSegment(const string & name) {
+  return name == "git" || name == "kube" || name == "load";
+} // isSegment
+
+//_____________ get(const string&, const string&, string&) _____________ //
+
+bool PromptSegments::get(const string & segment, const string & dir, string & value) {
+  unique_lock<mutex> guard(lock, try_to_lock);
+  if(!guard.owns_lock()) { // the worker is storing a result, so one is about to arrive anyway
+    value = "";
+    return false;
+  } // if
+  Key key(segment, (segment == "git") ? dir : ""); // only git depends on the dir
+  if(cache.size() > MAX_ENTRIES && cache.count(key) == 0) {
+    for(auto it = cache.begin(); it != cache.end(); ) {
+      it = (it->second.pending) ? next(it) : cache.erase(it);
+    } // for
+  } // if
+  Entry & e = cache[key];
+  value = e.value;
+  bool fresh = e.valid && e.generation == generation && time(nullptr) - e.computed < TTL;
+  if(!fresh && !e.pending) {
+    e.pending = true;
+    queue.push_back(key);
+    wake.notify_one();
+  } // if
+  return fresh;
+} // get
+
+//_____________ invalidate(vector<string>) _____________ //
+
+void PromptSegments::invalidate(vector<string> env) {
+  lock_guard<mutex> guard(lock);
+  this->generation++;
+  this->env.swap(env);
+} // invalidate
+
+//_____________ drainNotify() _____________ //
+
+void PromptSegments::drainNotify() {
+  char buf[64];
+  while(read(notify[0], buf, sizeof(buf)) > 0) {}
+} // drainNotify
+
+//_____________ owns(pid_t) _____________ //
+
+bool PromptSegments::owns(pid_t pid) {
+  lock_guard<mutex> guard(helperLock);
+  return helpers.count(pid) != 0;
+} // owns
+
+//_____________ run() _____________ //
+
+void PromptSegments::run() {
+  unique_lock<mutex> guard(lock);
+  while(true) {
+    wake.wait(guard, [this]() { return !queue.empty(); });
+    Key key = queue.front();
+    queue.pop_front();
+    unsigned long gen = generation;
+    vector<string> snapshot = env;
+    guard.unlock();
+    string value = compute(key, snapshot);
+    guard.lock();
+    Entry & e = cache[key];
+    e.value = value;
+    e.generation = gen; // stale already if a command ran meanwhile
+    e.computed = time(nullptr);
+    e.valid = true;
+    e.pending = false;
+    // after unlocking, so the redraw this triggers doesn't find the cache locked
+    guard.unlock();
+    if(write(notify[1], "", 1) == -1) {} // a full pipe already means "redraw"
+    guard.lock();
+  } // while
+} // run
+
+//_____________ compute(const Key&, const vector<string>&) _____________ //
+
+string PromptSegments::compute(const Key & key, const vector<string> & env) {
+  if(key.first == "git") {
+    // don't spawn git at all outside of a work tree
+    struct stat sb;
+    string up = key.second;
+    while(stat((up + "/.git").c_str(), &sb) == -1) {
+      if(up == "" || up == "/") return "";
+      up = up.substr(0, up.find_last_of('/'));
+    } // while
+    string out;
+    if(!capture({"git", "--no-optional-locks", "-C", key.second, "status", "--porcelain", "--branch",
+	  "--untracked-files=no"}, env, out)) {
+      return "";
+    } // if
+    // "## BRANCH...UPSTREAM [ahead N]", "## No commits yet on BRANCH" or "## HEAD (no branch)"
+    string first = out.substr(0, out.find('\n'));
+    if(first.compare(0, 3, "## ") != 0) return "";
+    string branch = first.substr(3);
+    if(branch.compare(0, 18, "No commits yet on ") == 0) branch = branch.substr(18);
+    branch = branch.substr(0, branch.find("..."));
+    if(branch == "HEAD (no branch)") branch = "HEAD";
+    bool dirty = (out.find('\n') != string::npos && out.find('\n') + 1 < out.size());
+    return " (" + branch + ((dirty) ? "*" : "") + ")";
+  } else if(key.first == "kube") {
+    string config = env_value(env, "KUBECONFIG");
+    config = (config != "") ? config.substr(0, config.find(':')) : env_value(env, "HOME") + "/.kube/config";
+    ifstream in(config);
+    string line;
+    while(getline(in, line)) {
+      if(line.compare(0, 16, "current-context:") != 0) continue;
+      string ctx = line.substr(16);
+      ctx.erase(0, ctx.find_first_not_of(" \t\"'"));
+      ctx.erase(ctx.find_last_not_of(" \t\"'\r") + 1);
+      return (ctx == "") ? "" : " [" + ctx + "]";
+    } // while
+    return "";
+  } else if(key.first == "load") {
+    ifstream in("/proc/loadavg");
+    string load;
+    return (in >> load) ? " " + load : "";
+  } // if/else
+  return "";
+} // compute
+
+//_____________ capture(const vector<string>&, const vector<string>&, string&) _____________ //
+
+bool PromptSegments::capture(const vector<string> & argv, const vector<string> & env, string & out) {
+  int fds[2];
+  if(pipe2(fds, O_CLOEXEC) == -1) return false;
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  // its own process group, so ^C at the prompt and terminal job control leave it alone
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t none, defaults;
+  sigemptyset(&none);
+  sigfillset(&defaults);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+  vector<char *> args, envp;
+  for(unsigned int i = 0; i < argv.size(); i++) args.push_back((char *) argv[i].c_str());
+  args.push_back(nullptr);
+  for(unsigned int i = 0; i < env.size(); i++) envp.push_back((char *) env[i].c_str());
+  envp.push_back(nullptr);
+  // resolves the command in the snapshot's PATH, since environ may be changing under us
+  string path = env_value(env, "PATH");
+  string prog = "";
+  stringstream ss(path);
+  string dir;
+  while(prog == "" && getline(ss, dir, ':')) {
+    string candidate = ((dir == "") ? "." : dir) + "/" + argv[0];
+    if(access(candidate.c_str(), X_OK) == 0) prog = candidate;
+  } // while
+  pid_t pid = -1;
+  {
+    lock_guard<mutex> guard(helperLock); // registered before the shell could see it
+    if(prog != "" && posix_spawn(&pid, prog.c_str(), &actions, &attr, &args[0], &envp[0]) == 0) {
+      helpers.insert(pid);
+    } else {
+      pid = -1;
+    } // if/else
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  close(fds[1]);
+  if(pid == -1) {
+    close(fds[0]);
+    return false;
+  } // if
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bool timedOut = false;
+  char buf[4096];
+  while(true) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long left = DEADLINE_MS - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    if(left <= 0 || poll(&pfd, 1, left) == 0) {
+      timedOut = true;
+      break;
+    } // if
+    ssize_t n = read(fds[0], buf, sizeof(buf));
+    if(n == -1 && errno == EINTR) continue;
+    if(n <= 0) break;
+    if(out.size() < (1 << 16)) out.append(buf, n); // only the first lines are needed
+  } // while
+  close(fds[0]);
+  if(timedOut) kill(-pid, SIGKILL); // its whole process group, in case it forked
+  int status;
+  while(waitpid(pid, &status, 0) == -1 && errno == EINTR) {}
+  {
+    lock_guard<mutex> guard(helperLock);
+    helpers.erase(pid);
+  }
+  return !timedOut && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+} // capture
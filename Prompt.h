@@ -0,0 +1,128 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Computes prompt segments that are too slow to compute while the user waits (the VCS
+ * branch and dirty state of the cwd, the Kubernetes context, the load average) on a
+ * worker thread. get() never blocks: it returns the last value cached for the segment (and
+ * dir), and schedules a refresh if that value is missing or stale. When a refresh completes,
+ * a byte is written to notifyFd(), so the REPL can redraw the prompt.
+ *
+ * Values go stale after every command (which may have changed them) and after TTL seconds.
+ * Every computation is bounded by DEADLINE_MS; a helper process that takes longer is killed
+ * and its segment is left empty.
+ */
+class PromptSegments {
+ private:
+  struct Entry {
+    std::string value;
+    unsigned long generation = 0;
+    time_t computed = 0;
+    bool valid = false;
+    bool pending = false;
+  }; // Entry
+  typedef std::pair<std::string, std::string> Key; // (segment, dir)
+  static const size_t MAX_ENTRIES = 256;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::deque<Key> queue;
+  std::map<Key, Entry> cache;
+  std::mutex helperLock; // guards helpers, and is held across spawning one
+  std::set<pid_t> helpers;
+  std::vector<std::string> env;
+  unsigned long generation = 1;
+  int notify[2];
+  std::thread worker;
+
+  /**
+   * The worker thread's loop. Computes each queued segment and caches its value.
+   */
+  void run();
+  /**
+   * Computes the value of the given segment.
+   *
+   * @param key the segment and the dir to compute it for
+   * @param env the environment to compute it with
+   * @return the value, or "" if it doesn't apply or couldn't be computed in time
+   */
+  std::string compute(const Key & key, const std::vector<std::string> & env);
+  /**
+   * Runs the given command and captures its stdout, killing it after DEADLINE_MS.
+   *
+   * @param argv the command and its args
+   * @param env the environment to run it with
+   * @param out set to the output of the command
+   * @return true if the command exited successfully in time, false if not
+   */
+  bool capture(const std::vector<std::string> & argv, const std::vector<std::string> & env, std::string & out);
+ public:
+  /**
+   * Maximum milliseconds spent computing a segment.
+   */
+  static const int DEADLINE_MS = 300;
+  /**
+   * Maximum seconds a value is shown without being refreshed.
+   */
+  static const time_t TTL = 10;
+  /**
+   * Constructor. Starts the worker thread.
+   *
+   * @param std::vector<std::string> the environment to compute segments with
+   */
+  PromptSegments(std::vector<std::string>);
+  /**
+   * Determines if the given name is a segment that can be computed.
+   *
+   * @param const std::string& the name
+   * @return true if it is a segment, false if not
+   */
+  static bool isSegment(const std::string &);
+  /**
+   * Gets the cached value of the given segment, scheduling a refresh if it is missing or
+   * stale. Never blocks: if the worker holds the cache, the value is reported as pending.
+   *
+   * @param segment the name of the segment
+   * @param dir the dir to compute it for
+   * @param value set to the cached value ("" if there is none)
+   * @return true if the value is fresh, false if a refresh is pending
+   */
+  bool get(const std::string & segment, const std::string & dir, std::string & value);
+  /**
+   * Marks every cached value as stale, e.g., after a command has run.
+   *
+   * @param std::vector<std::string> the environment to compute segments with from now on
+   */
+  void invalidate(std::vector<std::string>);
+  /**
+   * Gets the fd that becomes readable when a refresh completes.
+   *
+   * @return the fd
+   */
+  int notifyFd() const { return notify[0]; }
+  /**
+   * Drains the bytes written to notifyFd().
+   */
+  void drainNotify();
+  /**
+   * Determines if the given process is a helper spawned by the worker thread, which the
+   * shell must not reap.
+   *
+   * @param pid_t the pid of the process
+   * @return true if it is a helper, false if not
+   */
+  bool owns(pid_t);
+
+}; // PromptSegments
+
+#endif
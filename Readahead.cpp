@@ -0,0 +1,233 @@
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/stat.h>
+#include "Readahead.h"
+
+using namespace std;
+
+struct DepsEntry {
+  time_t mtime;
+  vector<string> deps; // resolved paths of everything the executable needs, recursively
+}; // DepsEntry
+
+struct ReadaheadRequest {
+  string path;
+  bool libs;
+  string ldpath; // $LD_LIBRARY_PATH when queued, since the helper mustn't call getenv()
+}; // ReadaheadRequest
+
+// the requests for a process's helper thread, and the dependency lists only it touches.
+// never destroyed, so nothing is torn down under the helper at exit
+struct ReadaheadQueue {
+  pid_t owner; // the process whose helper thread serves this queue
+  mutex lock;
+  condition_variable ready;
+  deque<ReadaheadRequest> requests;
+  map<string, DepsEntry> deps_cache;
+}; // ReadaheadQueue
+
+static ReadaheadQueue * readahead_queue = nullptr;
+
+static const char * DEFAULT_LIB_DIRS[] = {
+  "/lib/x86_64-linux-gnu", "/usr/lib/x86_64-linux-gnu", "/lib/aarch64-linux-gnu",
+  "/usr/lib/aarch64-linux-gnu", "/lib64", "/usr/lib64", "/lib", "/usr/lib", "/usr/local/lib",
+};
+
+/**
+ * Issues WILLNEED on the whole of the given open file.
+ */
+static void advise(int fd) {
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+} // advise
+
+/**
+ * Reads the DT_NEEDED names and the RUNPATH/RPATH dirs of the ELF file open on fd. Only
+ * reads the headers and the dynamic section, via pread().
+ *
+ * @return false if it isn't a native ELF file
+ */
+static bool elf_needed(int fd, vector<string> & needed, vector<string> & runpath) {
+  ElfW(Ehdr) eh;
+  if(pread(fd, &eh, sizeof(eh), 0) != sizeof(eh) || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+     eh.e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+     eh.e_phentsize != sizeof(ElfW(Phdr)) || eh.e_phnum == 0 || eh.e_phnum > 256) {
+    return false;
+  } // if
+  vector<ElfW(Phdr)> ph(eh.e_phnum);
+  ssize_t phsize = eh.e_phnum * sizeof(ElfW(Phdr));
+  if(pread(fd, ph.data(), phsize, eh.e_phoff) != phsize) return false;
+  const ElfW(Phdr) * dynamic = nullptr;
+  for(unsigned int i = 0; i < ph.size(); i++) {
+    if(ph[i].p_type == PT_DYNAMIC) dynamic = &ph[i];
+  } // for
+  if(dynamic == nullptr || dynamic->p_filesz > (1 << 20)) return true; // static
+  vector<ElfW(Dyn)> dyn(dynamic->p_filesz / sizeof(ElfW(Dyn)));
+  ssize_t dynsize = dyn.size() * sizeof(ElfW(Dyn));
+  if(pread(fd, dyn.data(), dynsize, dynamic->p_offset) != dynsize) return false;
+  ElfW(Addr) strtab = 0;
+  size_t strsz = 0;
+  for(unsigned int i = 0; i < dyn.size() && dyn[i].d_tag != DT_NULL; i++) {
+    if(dyn[i].d_tag == DT_STRTAB) strtab = dyn[i].d_un.d_ptr;
+    if(dyn[i].d_tag == DT_STRSZ) strsz = dyn[i].d_un.d_val;
+  } // for
+  // DT_STRTAB is a virtual address, so map it back to a file offset through its PT_LOAD
+  off_t stroff = -1;
+  for(unsigned int i = 0; i < ph.size(); i++) {
+    if(ph[i].p_type == PT_LOAD && strtab >= ph[i].p_vaddr && strtab < ph[i].p_vaddr + ph[i].p_filesz) {
+      stroff = ph[i].p_offset + (strtab - ph[i].p_vaddr);
+    } // if
+  } // for
+  if(stroff == -1 || strsz == 0 || strsz > (1 << 20)) return false;
+  string strings(strsz, '\0');
+  if(pread(fd, &strings[0], strsz, stroff) != (ssize_t) strsz) return false;
+  for(unsigned int i = 0; i < dyn.size() && dyn[i].d_tag != DT_NULL; i++) {
+    if(dyn[i].d_un.d_val >= strsz) continue;
+    const char * str = strings.c_str() + dyn[i].d_un.d_val;
+    if(dyn[i].d_tag == DT_NEEDED) {
+      needed.push_back(str);
+    } else if(dyn[i].d_tag == DT_RUNPATH || dyn[i].d_tag == DT_RPATH) {
+      stringstream ss(str);
+      string dir;
+      while(getline(ss, dir, ':')) runpath.push_back(dir);
+    } // if/else
+  } // for
+  return true;
+} // elf_needed
+
+/**
+ * Finds the file a DT_NEEDED name refers to.
+ *
+ * @return the path of the library, or "" if it wasn't found
+ */
+static string find_library(const string & name, const vector<string> & runpath, const string & origin,
+			   const string & ldpath) {
+  if(name.find('/') != string::npos) return name;
+  vector<string> dirs;
+  for(unsigned int i = 0; i < runpath.size(); i++) {
+    string dir = runpath[i];
+    size_t pos = dir.find("$ORIGIN");
+    if(pos != string::npos) dir.replace(pos, 7, origin);
+    dirs.push_back(dir);
+  } // for
+  stringstream ss(ldpath);
+  string dir;
+  while(getline(ss, dir, ':')) if(dir != "") dirs.push_back(dir);
+  for(const char * dir : DEFAULT_LIB_DIRS) dirs.push_back(dir);
+  struct stat sb;
+  for(unsigned int i = 0; i < dirs.size(); i++) {
+    string candidate = dirs[i] + "/" + name;
+    if(stat(candidate.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) return candidate;
+  } // for
+  return "";
+} // find_library
+
+/**
+ * Adds the resolved dependencies of the ELF file open on fd (at path) to deps, recursively.
+ */
+static void collect_deps(int fd, const string & path, const string & ldpath, set<string> & seen,
+			 vector<string> & deps, int depth) {
+  vector<string> needed, runpath;
+  if(depth > 8 || !elf_needed(fd, needed, runpath)) return;
+  string origin = path.substr(0, path.find_last_of('/'));
+  for(unsigned int i = 0; i < needed.size(); i++) {
+    string lib = find_library(needed[i], runpath, origin, ldpath);
+    if(lib == "" || !seen.insert(lib).second) continue;
+    deps.push_back(lib);
+    int libfd = open(lib.c_str(), O_RDONLY | O_CLOEXEC);
+    if(libfd == -1) continue;
+    collect_deps(libfd, lib, ldpath, seen, deps, depth + 1);
+    close(libfd);
+  } // for
+} // collect_deps
+
+/**
+ * Reads ahead an executable as readahead_exec() describes. Only called on the helper thread.
+ */
+static void read_ahead(const ReadaheadRequest & r, map<string, DepsEntry> & deps_cache) {
+  const string & path = r.path;
+  bool libs = r.libs;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd == -1) return;
+  advise(fd);
+  char magic[128] = "";
+  ssize_t n = pread(fd, magic, sizeof(magic) - 1, 0);
+  if(n > 2 && magic[0] == '#' && magic[1] == '!') { // a script, so its interpreter is what runs
+    string line(magic + 2, n - 2);
+    line = line.substr(0, line.find('\n'));
+    line.erase(0, line.find_first_not_of(" \t"));
+    string interpreter = line.substr(0, line.find_first_of(" \t"));
+    close(fd);
+    if(interpreter != "" && interpreter != path) {
+      read_ahead(ReadaheadRequest{interpreter, libs, r.ldpath}, deps_cache);
+    } // if
+    return;
+  } // if
+  if(libs) {
+    struct stat sb;
+    fstat(fd, &sb);
+    auto it = deps_cache.find(path);
+    if(it == deps_cache.end() || it->second.mtime != sb.st_mtime) {
+      DepsEntry e;
+      e.mtime = sb.st_mtime;
+      set<string> seen;
+      collect_deps(fd, path, r.ldpath, seen, e.deps, 0);
+      it = deps_cache.insert(make_pair(path, e)).first;
+      it->second = e;
+    } // if
+    for(unsigned int i = 0; i < it->second.deps.size(); i++) {
+      int libfd = open(it->second.deps[i].c_str(), O_RDONLY | O_CLOEXEC);
+      if(libfd == -1) continue;
+      advise(libfd);
+      close(libfd);
+    } // for
+  } // if
+  close(fd);
+} // read_ahead
+
+/**
+ * The helper thread's loop: serves the given queue's requests, in order, forever.
+ */
+static void serve(ReadaheadQueue * q) {
+  while(true) {
+    unique_lock<mutex> guard(q->lock);
+    q->ready.wait(guard, [q] { return !q->requests.empty(); });
+    ReadaheadRequest r = std::move(q->requests.front());
+    q->requests.pop_front();
+    guard.unlock();
+    read_ahead(r, q->deps_cache);
+  } // while
+} // serve
+
+void readahead_exec(const string & path, bool libs) {
+  if(readahead_queue == nullptr || readahead_queue->owner != getpid()) {
+    // a forked child has no helper thread, and a copy of the parent's queue that may have
+    // been mid-update, so it is abandoned for a new one
+    readahead_queue = new ReadaheadQueue();
+    readahead_queue->owner = getpid();
+    sigset_t all, old; // signals are the main thread's to handle
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    thread(serve, readahead_queue).detach();
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  } // if
+  const char * ldpath = getenv("LD_LIBRARY_PATH");
+  unique_lock<mutex> guard(readahead_queue->lock);
+  if(readahead_queue->requests.size() >= READAHEAD_MAX_QUEUED) return;
+  readahead_queue->requests.push_back(ReadaheadRequest{path, libs, (ldpath != nullptr) ? ldpath : ""});
+  guard.unlock();
+  readahead_queue->ready.notify_one();
+} // readahead_exec
@@ -0,0 +1,29 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <string>
+
+/**
+ * Asks the kernel to start reading the given executable into the page cache
+ * (posix_fadvise(POSIX_FADV_WILLNEED)), so that exec() and the page faults after it don't
+ * wait on cold storage. The reads happen asynchronously, and so does the rest: the request
+ * is queued for a helper thread (started by the first one in each process), which opens
+ * the files and parses their headers, so the caller never waits on a cold disk. At most
+ * READAHEAD_MAX_QUEUED requests wait at a time; more are dropped, since this is only a hint.
+ *
+ * For a script with a #! line, its interpreter is read ahead too. With libs, so are the
+ * shared libraries the executable needs (its DT_NEEDED entries, and theirs), searched for
+ * in its RUNPATH/RPATH, $LD_LIBRARY_PATH and the default library dirs. Dependency lists are
+ * cached per executable (and mtime), so repeated commands only pay for the fadvise calls.
+ *
+ * @param path the path of the executable
+ * @param libs true if its shared libraries should be read ahead too
+ */
+void readahead_exec(const std::string & path, bool libs);
+
+/**
+ * The most read-ahead requests that may wait for the helper thread at a time.
+ */
+const unsigned int READAHEAD_MAX_QUEUED = 64;
+
+#endif
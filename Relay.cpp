@@ -0,0 +1,512 @@
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "Relay.h"
+
+using namespace std;
+
+static const size_t CHUNK = 1 << 16;     // bytes per splice
+static const unsigned BATCH = 8;         // splices per io_uring_enter()
+static const unsigned NBUF = 8;          // registered buffers, i.e., reads per io_uring_enter()
+static const size_t BUFSZ = 1 << 17;     // bytes per buffer
+static const unsigned QUEUE_DEPTH = 64;
+static const uint64_t WRITE_TAG = 1 << 16; // user_data of writes is WRITE_TAG + index into outs
+
+/**
+ * Determines whether or not the given fd is a pipe.
+ */
+static bool isPipe(int fd) {
+  struct stat sb;
+  return fstat(fd, &sb) == 0 && S_ISFIFO(sb.st_mode);
+} // isPipe
+
+/**
+ * Determines whether or not the given fd is in non-blocking mode.
+ */
+static bool isNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && (flags & O_NONBLOCK);
+} // isNonBlocking
+
+// _______________ EpollEngine ______________ //
+
+class EpollEngine : public RelayEngine {
+ private:
+  int epfd = -1;
+  /**
+   * Waits until the given fd is ready for the given events. Regular files can't be added
+   * to an epoll set, but they are always ready, so they don't wait.
+   *
+   * @return -1 upon failure, 0 otherwise
+   */
+  int waitFor(int fd, uint32_t events);
+  /**
+   * Writes all of the given bytes to the given fd, waiting for it if it is non-blocking.
+   *
+   * @return -1 upon failure, 0 otherwise
+   */
+  int writeAll(int fd, const char * data, size_t len, RelayStats & stats);
+ public:
+  EpollEngine() { this->epfd = epoll_create1(EPOLL_CLOEXEC); }
+  ~EpollEngine() { if(epfd != -1) close(epfd); }
+  const char * name() const { return "epoll"; }
+  int relay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats);
+}; // EpollEngine
+
+int EpollEngine::waitFor(int fd, uint32_t events) {
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.fd = fd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    if(errno == EPERM) return 0; // regular file
+    return -1;
+  } // if
+  int n;
+  while((n = epoll_wait(epfd, &ev, 1, -1)) == -1 && errno == EINTR) {}
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+  return (n == -1) ? -1 : 0;
+} // waitFor
+
+int EpollEngine::writeAll(int fd, const char * data, size_t len, RelayStats & stats) {
+  while(len > 0) {
+    ssize_t n = write(fd, data, len);
+    stats.syscalls++;
+    if(n == -1) {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN && waitFor(fd, EPOLLOUT) == 0) continue;
+      return -1;
+    } // if
+    data += n;
+    len -= n;
+  } // while
+  return 0;
+} // writeAll
+
+int EpollEngine::relay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats) {
+  // zero-copy: splice straight from in to out, as long as one of them is a pipe
+  if(filter == nullptr && outs.size() == 1 && (isPipe(in) || isPipe(outs[0]))) {
+    while(1) {
+      ssize_t n = splice(in, nullptr, outs[0], nullptr, CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+      stats.syscalls++;
+      if(n > 0) {
+	stats.bytesIn += n;
+	stats.bytesOut += n;
+      } else if(n == 0) {
+	return 0;
+      } else if(errno == EAGAIN) {
+	if(waitFor(in, EPOLLIN) == -1 || waitFor(outs[0], EPOLLOUT) == -1) return -1;
+      } else if(errno == EINVAL) {
+	break; // one of the fds doesn't support splice (e.g., a terminal), so copy instead
+      } else if(errno != EINTR) {
+	return -1;
+      } // if/else
+    } // while
+  } // if
+  // buffered: read, filter, and write to every out
+  vector<char> buf(BUFSZ);
+  string out;
+  while(1) {
+    ssize_t n = read(in, buf.data(), buf.size());
+    stats.syscalls++;
+    if(n == -1) {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN && waitFor(in, EPOLLIN) == 0) continue;
+      return -1;
+    } // if
+    if(n == 0) break;
+    stats.bytesIn += n;
+    out.clear();
+    bool transformed = (filter != nullptr && filter->filter(buf.data(), n, out));
+    const char * data = (transformed) ? out.data() : buf.data();
+    size_t len = (transformed) ? out.size() : n;
+    for(unsigned int i = 0; i < outs.size(); i++) {
+      if(writeAll(outs[i], data, len, stats) == -1) return -1;
+    } // for
+    stats.bytesOut += len;
+  } // while
+  if(filter != nullptr) {
+    out.clear();
+    filter->finish(out);
+    for(unsigned int i = 0; i < outs.size(); i++) {
+      if(writeAll(outs[i], out.data(), out.size(), stats) == -1) return -1;
+    } // for
+    stats.bytesOut += out.size();
+  } // if
+  return 0;
+} // relay
+
+// _______________ UringEngine ______________ //
+
+class UringEngine : public RelayEngine {
+ private:
+  int ringfd = -1;
+  unsigned * sqHead = nullptr;
+  unsigned * sqTail = nullptr;
+  unsigned * sqMask = nullptr;
+  unsigned * sqArray = nullptr;
+  unsigned sqEntries = 0;
+  unsigned sqeTail = 0;
+  unsigned * cqHead = nullptr;
+  unsigned * cqTail = nullptr;
+  unsigned * cqMask = nullptr;
+  struct io_uring_sqe * sqes = nullptr;
+  struct io_uring_cqe * cqes = nullptr;
+  void * sqRing = MAP_FAILED;
+  void * cqRing = MAP_FAILED;
+  size_t sqRingSize = 0;
+  size_t cqRingSize = 0;
+  size_t sqesSize = 0;
+  char * buffers = nullptr;
+  bool fixedBuffers = false;
+  EpollEngine fallback;
+
+  /**
+   * Gets the next free submission queue entry, cleared. The entry is not submitted until
+   * submit() is called.
+   *
+   * @return the entry, or nullptr if the ring is full
+   */
+  struct io_uring_sqe * getSQE();
+  /**
+   * Gets the next free submission queue entry like getSQE(), but first submits the queued
+   * entries if the ring is full. Not for linked chains, which this would split.
+   *
+   * @return the entry, or nullptr upon failure (errno is set)
+   */
+  struct io_uring_sqe * nextSQE(RelayStats & stats);
+  /**
+   * Submits every queued entry with a single io_uring_enter().
+   */
+  int submit(RelayStats & stats);
+  /**
+   * Waits for and pops the next completion.
+   */
+  int waitCQE(struct io_uring_cqe & cqe, RelayStats & stats);
+  /**
+   * Splices from in to out in hard-linked batches, so each batch costs one system call.
+   *
+   * @return -1 upon failure, 1 if the fds can't be spliced, 0 otherwise
+   */
+  int spliceRelay(int in, int out, RelayStats & stats);
+  /**
+   * Reads into the registered buffers in hard-linked batches and writes each buffer (or the
+   * filter's output) to every out, as soon as its read completes.
+   */
+  int bufferedRelay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats);
+  /**
+   * Writes the given bytes to every out. Reads that complete in the meantime are recorded
+   * in readRes.
+   */
+  int writeOut(const vector<int> & outs, const char * data, size_t len, int bufIndex,
+	       int * readRes, RelayStats & stats);
+ public:
+  UringEngine();
+  ~UringEngine();
+  bool ok() const { return ringfd != -1 && buffers != nullptr; }
+  const char * name() const { return "io_uring"; }
+  int relay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats);
+}; // UringEngine
+
+UringEngine::UringEngine() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &p);
+  if(fd < 0) return;
+  this->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  this->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+  if(single) {
+    this->sqRingSize = this->cqRingSize = max(sqRingSize, cqRingSize);
+  } // if
+  this->sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(sqRing == MAP_FAILED) { close(fd); return; } // if
+  this->cqRing = (single) ? sqRing :
+    mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  this->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  void * s = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(cqRing == MAP_FAILED || s == MAP_FAILED) { close(fd); return; } // if
+  char * sq = (char *) sqRing;
+  char * cq = (char *) cqRing;
+  this->sqHead = (unsigned *) (sq + p.sq_off.head);
+  this->sqTail = (unsigned *) (sq + p.sq_off.tail);
+  this->sqMask = (unsigned *) (sq + p.sq_off.ring_mask);
+  this->sqArray = (unsigned *) (sq + p.sq_off.array);
+  this->sqEntries = p.sq_entries;
+  this->sqeTail = *sqTail;
+  this->cqHead = (unsigned *) (cq + p.cq_off.head);
+  this->cqTail = (unsigned *) (cq + p.cq_off.tail);
+  this->cqMask = (unsigned *) (cq + p.cq_off.ring_mask);
+  this->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  this->sqes = (struct io_uring_sqe *) s;
+  this->ringfd = fd;
+  // registered buffers spare the kernel from pinning the pages on every read/write
+  void * b = mmap(nullptr, NBUF * BUFSZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(b == MAP_FAILED) return;
+  this->buffers = (char *) b;
+  struct iovec iov[NBUF];
+  for(unsigned i = 0; i < NBUF; i++) {
+    iov[i].iov_base = buffers + i * BUFSZ;
+    iov[i].iov_len = BUFSZ;
+  } // for
+  this->fixedBuffers = (syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_BUFFERS, iov, NBUF) == 0);
+} // constructor
+
+UringEngine::~UringEngine() {
+  if(buffers != nullptr) munmap(buffers, NBUF * BUFSZ);
+  if(sqes != nullptr) munmap(sqes, sqesSize);
+  if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+  if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+  if(ringfd != -1) close(ringfd);
+} // destructor
+
+struct io_uring_sqe * UringEngine::getSQE() {
+  unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+  if(sqeTail - head >= sqEntries) return nullptr;
+  unsigned index = sqeTail & *sqMask;
+  struct io_uring_sqe * sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqArray[index] = index;
+  sqeTail++;
+  return sqe;
+} // getSQE
+
+struct io_uring_sqe * UringEngine::nextSQE(RelayStats & stats) {
+  struct io_uring_sqe * sqe = getSQE();
+  if(sqe != nullptr) return sqe;
+  if(submit(stats) == -1) return nullptr; // the kernel consumes what it is handed
+  if((sqe = getSQE()) == nullptr) errno = EBUSY;
+  return sqe;
+} // nextSQE
+
+int UringEngine::submit(RelayStats & stats) {
+  unsigned toSubmit = sqeTail - *sqTail;
+  __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+  while(toSubmit > 0) {
+    int n = syscall(__NR_io_uring_enter, ringfd, toSubmit, 0, 0, nullptr, 0);
+    stats.syscalls++;
+    if(n == -1) {
+      if(errno == EINTR || errno == EAGAIN) continue;
+      return -1;
+    } // if
+    toSubmit -= n;
+  } // while
+  return 0;
+} // submit
+
+int UringEngine::waitCQE(struct io_uring_cqe & cqe, RelayStats & stats) {
+  while(1) {
+    unsigned head = *cqHead;
+    if(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+      cqe = cqes[head & *cqMask];
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+      return 0;
+    } // if
+    stats.syscalls++;
+    if(syscall(__NR_io_uring_enter, ringfd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == -1 && errno != EINTR) {
+      return -1;
+    } // if
+  } // while
+} // waitCQE
+
+int UringEngine::spliceRelay(int in, int out, RelayStats & stats) {
+  uint64_t total = 0;
+  while(1) {
+    // hard links keep the splices in order without cancelling the rest of the batch on a short one
+    for(unsigned k = 0; k < BATCH; k++) {
+      struct io_uring_sqe * sqe = getSQE();
+      if(sqe == nullptr) { // the ring is smaller than a batch
+	errno = EBUSY;
+	return -1;
+      } // if
+      sqe->opcode = IORING_OP_SPLICE;
+      sqe->fd = out;
+      sqe->off = (uint64_t) -1;
+      sqe->splice_off_in = (uint64_t) -1;
+      sqe->splice_fd_in = in;
+      sqe->len = CHUNK;
+      sqe->splice_flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+      sqe->user_data = k;
+      if(k != BATCH - 1) sqe->flags = IOSQE_IO_HARDLINK;
+    } // for
+    if(submit(stats) == -1) return -1;
+    bool eof = false;
+    int err = 0;
+    for(unsigned k = 0; k < BATCH; k++) {
+      struct io_uring_cqe cqe;
+      if(waitCQE(cqe, stats) == -1) return -1;
+      if(cqe.res > 0) {
+	total += cqe.res;
+	stats.bytesIn += cqe.res;
+	stats.bytesOut += cqe.res;
+      } else if(cqe.res == 0) {
+	eof = true;
+      } else if(err == 0) {
+	err = -cqe.res;
+      } // if/else
+    } // for
+    if(err == EINVAL && total == 0) return 1;
+    if(err != 0) {
+      errno = err;
+      return -1;
+    } // if
+    if(eof) return 0;
+  } // while
+} // spliceRelay
+
+int UringEngine::writeOut(const vector<int> & outs, const char * data, size_t len, int bufIndex,
+			  int * readRes, RelayStats & stats) {
+  vector<size_t> written(outs.size(), 0);
+  unsigned pending = 0;
+  for(unsigned j = 0; j < outs.size(); j++) {
+    if(len == 0) break;
+    struct io_uring_sqe * sqe = nextSQE(stats);
+    if(sqe == nullptr) return -1;
+    sqe->opcode = (bufIndex >= 0 && fixedBuffers) ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = outs[j];
+    sqe->off = (uint64_t) -1;
+    sqe->addr = (uint64_t) data;
+    sqe->len = len;
+    if(bufIndex >= 0) sqe->buf_index = bufIndex;
+    sqe->user_data = WRITE_TAG + j;
+    pending++;
+  } // for
+  if(pending > 0 && submit(stats) == -1) return -1;
+  while(pending > 0) {
+    struct io_uring_cqe cqe;
+    if(waitCQE(cqe, stats) == -1) return -1;
+    if(cqe.user_data < NBUF) { // a read finished in the meantime
+      readRes[cqe.user_data] = cqe.res;
+      continue;
+    } // if
+    unsigned j = cqe.user_data - WRITE_TAG;
+    if(cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+      errno = -cqe.res;
+      return -1;
+    } // if
+    if(cqe.res == 0) { // would resubmit forever
+      errno = EIO;
+      return -1;
+    } // if
+    if(cqe.res > 0) written[j] += cqe.res;
+    if(written[j] == len) {
+      pending--;
+      continue;
+    } // if
+    // short write: write the rest (plain write, since it no longer starts at the buffer)
+    struct io_uring_sqe * sqe = nextSQE(stats);
+    if(sqe == nullptr) return -1;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = outs[j];
+    sqe->off = (uint64_t) -1;
+    sqe->addr = (uint64_t) (data + written[j]);
+    sqe->len = len - written[j];
+    sqe->user_data = WRITE_TAG + j;
+    if(submit(stats) == -1) return -1;
+  } // while
+  stats.bytesOut += len;
+  return 0;
+} // writeOut
+
+int UringEngine::bufferedRelay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats) {
+  bool eof = false;
+  int err = 0;
+  string out;
+  while(!eof && err == 0) {
+    // one hard-linked chain of reads, one per buffer, so they fill in order
+    for(unsigned k = 0; k < NBUF; k++) {
+      struct io_uring_sqe * sqe = getSQE();
+      if(sqe == nullptr) { // the ring is smaller than a chain
+	errno = EBUSY;
+	return -1;
+      } // if
+      sqe->opcode = (fixedBuffers) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+      sqe->fd = in;
+      sqe->off = (uint64_t) -1;
+      sqe->addr = (uint64_t) (buffers + k * BUFSZ);
+      sqe->len = BUFSZ;
+      sqe->buf_index = k;
+      sqe->user_data = k;
+      if(k != NBUF - 1) sqe->flags = IOSQE_IO_HARDLINK;
+    } // for
+    if(submit(stats) == -1) return -1;
+    int readRes[NBUF];
+    for(unsigned k = 0; k < NBUF; k++) readRes[k] = INT_MIN;
+    // handles each buffer as soon as it (and every buffer before it) has been read
+    unsigned next = 0;
+    while(next < NBUF) {
+      if(readRes[next] == INT_MIN) {
+	struct io_uring_cqe cqe;
+	if(waitCQE(cqe, stats) == -1) return -1;
+	if(cqe.user_data < NBUF) readRes[cqe.user_data] = cqe.res;
+	continue;
+      } // if
+      int res = readRes[next];
+      if(res == 0) {
+	eof = true;
+      } else if(res < 0 && err == 0) {
+	err = -res;
+      } else if(res > 0 && !eof && err == 0) {
+	stats.bytesIn += res;
+	const char * data = buffers + next * BUFSZ;
+	out.clear();
+	if(filter != nullptr && filter->filter(data, res, out)) {
+	  if(writeOut(outs, out.data(), out.size(), -1, readRes, stats) == -1) err = errno;
+	} else {
+	  if(writeOut(outs, data, res, next, readRes, stats) == -1) err = errno;
+	} // if/else
+      } // if/else
+      next++;
+    } // while
+  } // while
+  if(err != 0) {
+    errno = err;
+    return -1;
+  } // if
+  if(filter != nullptr) {
+    out.clear();
+    filter->finish(out);
+    int unused[NBUF];
+    if(writeOut(outs, out.data(), out.size(), -1, unused, stats) == -1) return -1;
+  } // if
+  return 0;
+} // bufferedRelay
+
+int UringEngine::relay(int in, const vector<int> & outs, RelayFilter * filter, RelayStats & stats) {
+  // io_uring hands EAGAIN on non-blocking fds back to us, so leave those to epoll
+  bool nonblocking = isNonBlocking(in);
+  for(unsigned int i = 0; i < outs.size(); i++) {
+    if(isNonBlocking(outs[i])) nonblocking = true;
+  } // for
+  if(nonblocking) return fallback.relay(in, outs, filter, stats);
+  if(filter == nullptr && outs.size() == 1 && (isPipe(in) || isPipe(outs[0]))) {
+    int res = spliceRelay(in, outs[0], stats);
+    if(res != 1) return res;
+  } // if
+  return bufferedRelay(in, outs, filter, stats);
+} // relay
+
+// _______________ RelayEngine ______________ //
+
+RelayEngine * RelayEngine::create() {
+  const char * engine = getenv("RELAY_ENGINE");
+  if(engine != nullptr && string(engine) == "io_uring") {
+    UringEngine * uring = new UringEngine();
+    if(uring->ok()) return uring;
+    delete uring;
+  } // if
+  return createFallback();
+} // create
+
+RelayEngine * RelayEngine::createFallback() {
+  return new EpollEngine();
+} // createFallback
@@ -0,0 +1,322 @@
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <link.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include "Sampler.h"
+
+using namespace std;
+
+// each sample is its depth followed by its frames, innermost first
+static uintptr_t * buffer = nullptr;
+static atomic<size_t> used(0);
+static atomic<size_t> samples(0);
+static atomic<size_t> dropped(0);
+static bool running = false;
+static int perfFd = -1; // the task-clock event, or -1 when sampling with setitimer()
+static const char * clockName = "setitimer";
+static struct sigaction oldAction;
+
+/**
+ * Records the stack that SIGPROF interrupted. Only touches the preallocated buffer.
+ */
+static void on_sigprof(int) {
+  int saved = errno;
+  void * frames[SAMPLER_MAX_DEPTH + 2];
+  int n = backtrace(frames, SAMPLER_MAX_DEPTH + 2);
+  int skip = (n > 2) ? 2 : n; // this handler and the signal trampoline
+  size_t depth = n - skip;
+  size_t at = used.fetch_add(depth + 1);
+  if(at + depth + 1 > SAMPLER_CAPACITY) {
+    dropped++;
+  } else {
+    buffer[at] = depth;
+    for(size_t i = 0; i < depth; i++) buffer[at + 1 + i] = (uintptr_t) frames[skip + i];
+    samples++;
+  } // if/else
+  errno = saved;
+} // on_sigprof
+
+/**
+ * Opens a perf_event task clock that sends SIGPROF to the calling thread every 1/hz seconds
+ * of CPU time it uses. Unlike ITIMER_PROF, whose signals only come on scheduler ticks (at
+ * most CONFIG_HZ a second), its period is exact. Kernel time is sampled too, unless
+ * perf_event_paranoid forbids it.
+ *
+ * @return the enabled event's fd, or -1 if perf_event_open() isn't available
+ */
+static int open_task_clock(unsigned int hz) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_TASK_CLOCK;
+  attr.sample_period = 1000000000ULL / hz;
+  attr.wakeup_events = 1;
+  attr.disabled = 1;
+  int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  if(fd == -1 && (errno == EACCES || errno == EPERM)) {
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  } // if
+  if(fd == -1) return -1;
+  struct f_owner_ex owner = {F_OWNER_TID, (pid_t) syscall(SYS_gettid)};
+  if(fcntl(fd, F_SETFL, O_ASYNC) == -1 || fcntl(fd, F_SETSIG, SIGPROF) == -1 ||
+     fcntl(fd, F_SETOWN_EX, &owner) == -1 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) == -1) {
+    close(fd);
+    return -1;
+  } // if
+  return fd;
+} // open_task_clock
+
+//_____________ sampler_start(unsigned int) _____________ //
+
+int sampler_start(unsigned int hz) {
+  if(running) sampler_stop();
+  if(buffer == nullptr) {
+    void * mem = mmap(nullptr, SAMPLER_CAPACITY * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mem == MAP_FAILED) return -1;
+    buffer = (uintptr_t *) mem;
+    void * warmup[1];
+    backtrace(warmup, 1); // loads the unwinder now, rather than inside the first handler
+  } // if
+  used = 0;
+  samples = 0;
+  dropped = 0;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sigprof;
+  sa.sa_flags = SA_RESTART;
+  sigfillset(&sa.sa_mask);
+  if(sigaction(SIGPROF, &sa, &oldAction) == -1) return -1;
+  if(hz == 0) hz = 1;
+  perfFd = open_task_clock(hz);
+  clockName = (perfFd != -1) ? "perf_event" : "setitimer";
+  if(perfFd != -1) {
+    running = true;
+    return 0;
+  } // if
+  long usec = 1000000L / hz;
+  struct itimerval timer;
+  timer.it_interval.tv_sec = usec / 1000000;
+  timer.it_interval.tv_usec = usec % 1000000;
+  timer.it_value = timer.it_interval;
+  if(setitimer(ITIMER_PROF, &timer, nullptr) == -1) {
+    sigaction(SIGPROF, &oldAction, nullptr);
+    return -1;
+  } // if
+  running = true;
+  return 0;
+} // sampler_start
+
+//_____________ sampler_stop() _____________ //
+
+int sampler_stop() {
+  if(!running) return 0;
+  running = false;
+  if(perfFd != -1) {
+    ioctl(perfFd, PERF_EVENT_IOC_DISABLE, 0);
+    close(perfFd);
+    perfFd = -1;
+  } else {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    if(setitimer(ITIMER_PROF, &timer, nullptr) == -1) return -1;
+  } // if/else
+  return sigaction(SIGPROF, &oldAction, nullptr);
+} // sampler_stop
+
+//_____________ sampler_running() _____________ //
+
+bool sampler_running() {
+  return running;
+} // sampler_running
+
+//_____________ sampler_clock() _____________ //
+
+const char * sampler_clock() {
+  return clockName;
+} // sampler_clock
+
+//_____________ sampler_count(size_t&) _____________ //
+
+size_t sampler_count(size_t & lost) {
+  lost = dropped;
+  return samples;
+} // sampler_count
+
+/**
+ * A function in the shell's own symbol table.
+ */
+struct SamplerSymbol {
+  uintptr_t start;
+  uintptr_t size;
+  string name;
+  bool operator<(const SamplerSymbol & other) const { return start < other.start; }
+}; // SamplerSymbol
+
+/**
+ * Gets the load address of the shell's executable (0 unless it is position-independent).
+ */
+static int find_bias(struct dl_phdr_info * info, size_t, void * data) {
+  *(uintptr_t *) data = info->dlpi_addr;
+  return 1; // the executable comes first
+} // find_bias
+
+/**
+ * Reads the functions in the .symtab (or, if stripped, .dynsym) of the shell's executable,
+ * relocated to where it is loaded, sorted by address.
+ */
+static vector<SamplerSymbol> load_symbols() {
+  vector<SamplerSymbol> symbols;
+  ifstream in("/proc/self/exe", ios::binary);
+  string elf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  if(elf.size() < sizeof(Elf64_Ehdr) || memcmp(elf.data(), ELFMAG, SELFMAG) != 0 || elf[EI_CLASS] != ELFCLASS64) {
+    return symbols;
+  } // if
+  const Elf64_Ehdr * eh = (const Elf64_Ehdr *) elf.data();
+  if(eh->e_shoff == 0 || eh->e_shoff + (size_t) eh->e_shnum * sizeof(Elf64_Shdr) > elf.size()) return symbols;
+  const Elf64_Shdr * sections = (const Elf64_Shdr *) (elf.data() + eh->e_shoff);
+  const Elf64_Shdr * table = nullptr;
+  for(int i = 0; i < eh->e_shnum; i++) {
+    if(sections[i].sh_type == SHT_SYMTAB) table = &sections[i];
+    if(sections[i].sh_type == SHT_DYNSYM && table == nullptr) table = &sections[i];
+  } // for
+  if(table == nullptr || table->sh_link >= eh->e_shnum) return symbols;
+  const Elf64_Shdr & strtab = sections[table->sh_link];
+  if(table->sh_offset + table->sh_size > elf.size() || strtab.sh_offset + strtab.sh_size > elf.size()) return symbols;
+  uintptr_t bias = 0;
+  dl_iterate_phdr(find_bias, &bias);
+  const Elf64_Sym * syms = (const Elf64_Sym *) (elf.data() + table->sh_offset);
+  for(size_t i = 0; i < table->sh_size / sizeof(Elf64_Sym); i++) {
+    if(ELF64_ST_TYPE(syms[i].st_info) != STT_FUNC || syms[i].st_value == 0) continue;
+    if(syms[i].st_name >= strtab.sh_size) continue;
+    symbols.push_back({bias + syms[i].st_value, syms[i].st_size, elf.data() + strtab.sh_offset + syms[i].st_name});
+  } // for
+  sort(symbols.begin(), symbols.end());
+  return symbols;
+} // load_symbols
+
+/**
+ * Demangles a symbol name and strips its parameter lists and qualifiers, so that e.g.
+ * "_Z8run_lineRKNSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEEEPKSt6vectorIS4_SaIS4_EE"
+ * becomes "run_line".
+ */
+static string function_name(const char * mangled) {
+  int status;
+  char * demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  string name = (status == 0 && demangled != nullptr) ? demangled : mangled;
+  free(demangled);
+  string out;
+  int angles = 0;
+  for(size_t i = 0; i < name.size(); i++) {
+    char c = name[i];
+    if(out.size() >= 8 && out.compare(out.size() - 8, 8, "operator") == 0) { // operator<<, operator(), ...
+      size_t len = (name.compare(i, 2, "()") == 0) ? 2 : strspn(name.c_str() + i, "<>=!+-*/%&|^~[],");
+      if(len > 0) {
+	out.append(name, i, len);
+	i += len - 1;
+	continue;
+      } // if
+    } // if
+    if(c == '(' && angles == 0) { // skips the parameter list
+      for(int parens = 0; i < name.size(); i++) {
+	if(name[i] == '(') parens++;
+	if(name[i] == ')' && --parens == 0) break;
+      } // for
+      continue;
+    } // if
+    if(c == '<') angles++;
+    if(c == '>' && angles > 0) angles--;
+    if(c == ';') c = ':'; // ';' separates frames
+    out += c;
+  } // for
+  if(out.size() > 6 && out.compare(out.size() - 6, 6, " const") == 0) out.erase(out.size() - 6);
+  return out;
+} // function_name
+
+/**
+ * Names the function that the given return address is in.
+ */
+static string frame_name(uintptr_t pc, const vector<SamplerSymbol> & symbols) {
+  pc--; // inside the call, not after it
+  auto it = upper_bound(symbols.begin(), symbols.end(), SamplerSymbol{pc, 0, ""});
+  if(it != symbols.begin()) {
+    --it;
+    if(pc < it->start + ((it->size > 0) ? it->size : 1)) return function_name(it->name.c_str());
+  } // if
+  Dl_info info;
+  if(dladdr((void *) pc, &info) != 0) {
+    if(info.dli_sname != nullptr) return function_name(info.dli_sname);
+    if(info.dli_fname != nullptr) {
+      const char * base = strrchr(info.dli_fname, '/');
+      return string("[") + ((base != nullptr) ? base + 1 : info.dli_fname) + "]";
+    } // if
+  } // if
+  return "[unknown]";
+} // frame_name
+
+//_____________ sampler_dump(ostream&) _____________ //
+
+void sampler_dump(ostream & out) {
+  // the handler must not write to the buffer while it is read
+  sigset_t prof, old;
+  sigemptyset(&prof);
+  sigaddset(&prof, SIGPROF);
+  pthread_sigmask(SIG_BLOCK, &prof, &old);
+  vector<SamplerSymbol> symbols = load_symbols();
+  unordered_map<uintptr_t, string> names;
+  map<string, size_t> stacks;
+  size_t count = samples;
+  for(size_t s = 0, at = 0; s < count; s++) {
+    size_t depth = buffer[at];
+    const uintptr_t * frames = buffer + at + 1;
+    at += depth + 1;
+    // outermost first, starting at main() when it is on the stack
+    vector<const string *> folded;
+    for(size_t i = 0; i < depth; i++) {
+      auto it = names.find(frames[i]);
+      if(it == names.end()) it = names.insert(make_pair(frames[i], frame_name(frames[i], symbols))).first;
+      folded.push_back(&it->second);
+      if(it->second == "main") break;
+    } // for
+    string stack;
+    for(auto it = folded.rbegin(); it != folded.rend(); ++it) {
+      if(!stack.empty()) stack += ';';
+      stack += **it;
+    } // for
+    stacks[(stack.empty()) ? "[unknown]" : stack]++;
+  } // for
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  vector<pair<size_t, const string *>> sorted;
+  for(auto & stack : stacks) sorted.push_back(make_pair(stack.second, &stack.first));
+  sort(sorted.begin(), sorted.end(), [](const pair<size_t, const string *> & a, const pair<size_t, const string *> & b) {
+      return a.first > b.first || (a.first == b.first && *a.second < *b.second);
+    });
+  for(auto & stack : sorted) out << *stack.second << " " << stack.first << "\n";
+  out.flush();
+} // sampler_dump
@@ -0,0 +1,75 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstddef>
+#include <iostream>
+
+/**
+ * A sampling profiler for the shell process itself, used by the 'profile' builtin. While
+ * running, a perf_event task clock (or, where perf_event_open() isn't allowed,
+ * setitimer(ITIMER_PROF)) sends SIGPROF every 1/hz seconds of CPU time the shell uses, and
+ * the handler appends the interrupted stack (as return addresses, from backtrace()) to a
+ * preallocated buffer. Nothing is symbolized or counted until the samples are dumped, so a
+ * sample costs only the unwind. Neither clock follows fork(), so only the shell's own CPU
+ * time (not its jobs') is sampled.
+ */
+
+/**
+ * Maximum number of frames recorded per sample.
+ */
+const int SAMPLER_MAX_DEPTH = 64;
+
+/**
+ * Number of slots (one per frame, plus one per sample) in the sample buffer. Once it
+ * fills up, further samples are dropped and counted.
+ */
+const size_t SAMPLER_CAPACITY = 1 << 20;
+
+/**
+ * Starts sampling, discarding the samples of any previous run.
+ *
+ * @param hz the number of samples per second of CPU time
+ * @return -1 upon any system call failure, 0 otherwise
+ */
+int sampler_start(unsigned int hz);
+
+/**
+ * Stops sampling. The samples taken are kept until the next sampler_start().
+ *
+ * @return -1 upon any system call failure, 0 otherwise
+ */
+int sampler_stop();
+
+/**
+ * Determines whether or not the sampler is running.
+ *
+ * @return true if it is, false if not
+ */
+bool sampler_running();
+
+/**
+ * Gets the name of the clock the sampler uses, or used last.
+ *
+ * @return "perf_event" or "setitimer"
+ */
+const char * sampler_clock();
+
+/**
+ * Gets the number of samples taken since the sampler was last started.
+ *
+ * @param dropped set to the number of samples dropped because the buffer was full
+ * @return the number of samples in the buffer
+ */
+size_t sampler_count(size_t & dropped);
+
+/**
+ * Writes the samples taken as folded stacks ("main;run_line;callBuiltIn COUNT", outermost
+ * frame first), most frequent first, as read by flamegraph.pl and speedscope. Functions in
+ * the shell are named from its own symbol table, and those in shared libraries with
+ * dladdr(); names are demangled, without their parameter lists.
+ *
+ * @param out the stream to write to
+ */
+void sampler_dump(std::ostream & out);
+
+#endif
@@ -0,0 +1,152 @@
+
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SharedCache.h"
+#include "Input.h"
+
+using namespace std;
+
+static const char SHCACHE_MAGIC[4] = {'1','7','S','C'};
+static const uint32_t SHCACHE_VERSION = 1;
+
+// file layout: a header page followed by NUM_SLOTS slots. A zero-filled file (fresh from
+// ftruncate) is a valid, empty cache once its magic is claimed.
+struct SharedCache::Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t numSlots;
+  uint32_t slotSize;
+  char pad[4096 - 16];
+}; // Header
+
+struct SharedCache::Slot {
+  uint32_t seq;      // odd while a writer holds the slot
+  char kind;         // 0 if the slot is empty
+  char pad;
+  uint16_t keyLen;
+  uint32_t valueLen;
+  uint32_t reserved;
+  uint64_t hash;
+  uint64_t stamp;
+  char data[MAX_DATA]; // key, followed by value
+}; // Slot
+
+// ___________ constructors/destructors ____________ //
+
+SharedCache::SharedCache(void * addr, size_t size) : size(size) {
+  this->header = (Header *) addr;
+  this->slots = (Slot *) ((char *) addr + sizeof(Header));
+} // constructor
+
+SharedCache::~SharedCache() {
+  munmap(header, size);
+} // destructor
+
+//_____________ open(const string&) _____________ //
+
+SharedCache * SharedCache::open(const string & path) {
+  size_t size = sizeof(Header) + NUM_SLOTS * sizeof(Slot);
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if(fd == -1) return nullptr;
+  struct stat sb;
+  if(fstat(fd, &sb) == -1 || sb.st_uid != getuid() || !S_ISREG(sb.st_mode) ||
+     ((size_t) sb.st_size < size && ftruncate(fd, size) == -1)) {
+    close(fd);
+    return nullptr;
+  } // if
+  void * addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED) return nullptr;
+  Header * header = (Header *) addr;
+  // the first instance to map a fresh file claims it by writing the geometry, then the magic
+  uint32_t zero = 0;
+  uint32_t magic;
+  memcpy(&magic, SHCACHE_MAGIC, 4);
+  if(__atomic_compare_exchange_n((uint32_t *) header->magic, &zero, 0xffffffff, false,
+				 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    header->version = SHCACHE_VERSION;
+    header->numSlots = NUM_SLOTS;
+    header->slotSize = sizeof(Slot);
+    __atomic_store_n((uint32_t *) header->magic, magic, __ATOMIC_RELEASE);
+  } // if
+  for(int i = 0; i < 1000 && __atomic_load_n((uint32_t *) header->magic, __ATOMIC_ACQUIRE) == 0xffffffff; i++) {
+    usleep(100); // another instance is claiming it
+  } // for
+  if(__atomic_load_n((uint32_t *) header->magic, __ATOMIC_ACQUIRE) != magic ||
+     header->version != SHCACHE_VERSION || header->numSlots != NUM_SLOTS ||
+     header->slotSize != sizeof(Slot)) {
+    munmap(addr, size);
+    return nullptr;
+  } // if
+  return new SharedCache(addr, size);
+} // open
+
+//_____________ defaultPath() _____________ //
+
+string SharedCache::defaultPath() {
+  const char * path = getenv("SHCACHE");
+  if(path != nullptr) return path;
+  return "/dev/shm/1730sh-" + to_string(getuid()) + ".cache";
+} // defaultPath
+
+//_____________ get(char, const string&, uint64_t, string&) _____________ //
+
+bool SharedCache::get(char kind, const string & key, uint64_t stamp, string & value) const {
+  uint64_t hash = fnv1a(key.data(), key.size(), (uint64_t) kind);
+  Slot copy;
+  for(uint32_t probe = 0; probe < PROBES; probe++) {
+    const Slot & slot = slots[(hash + probe) % NUM_SLOTS];
+    bool consistent = false;
+    for(int attempt = 0; attempt < 4 && !consistent; attempt++) {
+      uint32_t seq = __atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE);
+      if(seq & 1) continue; // being written
+      memcpy(&copy, &slot, sizeof(copy));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      consistent = (__atomic_load_n(&slot.seq, __ATOMIC_RELAXED) == seq);
+    } // for
+    if(!consistent) return false;
+    if(copy.kind == 0) return false; // end of the probe sequence
+    if(copy.hash != hash || copy.kind != kind || copy.keyLen != key.size() ||
+       (size_t) copy.keyLen + copy.valueLen > MAX_DATA || memcmp(copy.data, key.data(), key.size()) != 0) {
+      continue;
+    } // if
+    if(copy.stamp != stamp) return false;
+    value.assign(copy.data + copy.keyLen, copy.valueLen);
+    return true;
+  } // for
+  return false;
+} // get
+
+//_____________ put(char, const string&, uint64_t, const string&) _____________ //
+
+void SharedCache::put(char kind, const string & key, uint64_t stamp, const string & value) {
+  if(key.size() + value.size() > MAX_DATA) return;
+  uint64_t hash = fnv1a(key.data(), key.size(), (uint64_t) kind);
+  // reuse the key's slot or the first empty one; if neither, evict the first probed slot
+  Slot * slot = &slots[hash % NUM_SLOTS];
+  for(uint32_t probe = 0; probe < PROBES; probe++) {
+    Slot * s = &slots[(hash + probe) % NUM_SLOTS];
+    char k = __atomic_load_n(&s->kind, __ATOMIC_RELAXED);
+    if(k == 0 || (k == kind && __atomic_load_n(&s->hash, __ATOMIC_RELAXED) == hash)) {
+      slot = s;
+      break;
+    } // if
+  } // for
+  uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+  if((seq & 1) || !__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, false,
+					      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return; // another instance is writing it
+  } // if
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->kind = kind;
+  slot->keyLen = key.size();
+  slot->valueLen = value.size();
+  slot->hash = hash;
+  slot->stamp = stamp;
+  memcpy(slot->data, key.data(), key.size());
+  memcpy(slot->data + key.size(), value.data(), value.size());
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+} // put
@@ -0,0 +1,79 @@
+#ifndef SHAREDCACHE_H
+#define SHAREDCACHE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * A fixed-size hash table in a shared memory file (under /dev/shm), shared by every shell
+ * instance of a user. Used to share work that every instance would otherwise redo, like
+ * lexing script lines.
+ *
+ * Each slot is guarded by a seqlock: readers never block or write, and copy a slot out
+ * only if its sequence number was even and unchanged across the copy. A writer claims a
+ * slot by bumping its sequence number to odd with a compare-and-swap, and simply gives up
+ * if another writer holds it (it's only a cache). Entries carry a caller-supplied stamp
+ * (e.g., a hash of $PATH), and a lookup whose stamp doesn't match is a miss.
+ */
+class SharedCache {
+ private:
+  struct Slot;
+  struct Header;
+  static const uint32_t NUM_SLOTS = 4096;
+  static const uint32_t PROBES = 8;
+  Header * header = nullptr;
+  Slot * slots = nullptr;
+  size_t size = 0;
+
+  /**
+   * Constructor. Use open() instead.
+   */
+  SharedCache(void *, size_t);
+ public:
+  /**
+   * The most bytes a key and its value may take up together.
+   */
+  static const size_t MAX_DATA = 480;
+  /**
+   * Maps the given cache file, creating it if it doesn't exist. The file must be owned by
+   * the current user.
+   *
+   * @param path the path of the cache file
+   * @return the dynamically allocated cache, or nullptr if it can't be used
+   */
+  static SharedCache * open(const std::string & path);
+  /**
+   * Gets the default path of the cache file: $SHCACHE if set, otherwise a per-user file
+   * under /dev/shm.
+   *
+   * @return the path of the cache file, or "" if caching is disabled ($SHCACHE is empty)
+   */
+  static std::string defaultPath();
+  /**
+   * Destructor. Unmaps the cache file.
+   */
+  ~SharedCache();
+  /**
+   * Looks up the value stored for the given key.
+   *
+   * @param kind the kind of entry, so different kinds of keys never collide
+   * @param key the key
+   * @param stamp the stamp the entry must have been stored with
+   * @param value set to the value, if found
+   * @return true if found, false if not
+   */
+  bool get(char kind, const std::string & key, uint64_t stamp, std::string & value) const;
+  /**
+   * Stores a value for the given key, replacing any previous one. Does nothing if the key
+   * and value are too large, or if another instance is writing the same slot.
+   *
+   * @param kind the kind of entry
+   * @param key the key
+   * @param stamp the stamp to store the entry with
+   * @param value the value
+   */
+  void put(char kind, const std::string & key, uint64_t stamp, const std::string & value);
+
+}; // SharedCache
+
+#endif
@@ -0,0 +1,97 @@
+
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Snapshot.h"
+
+using namespace std;
+
+// on-disk layout: a header followed by count records of
+// [char type][uint32_t keylen][uint32_t valuelen][key][value]
+struct SnapshotHeader {
+  char magic[4];
+  uint32_t count;
+  uint64_t stamp;
+}; // SnapshotHeader
+
+static const char SNAPSHOT_MAGIC[4] = {'1','7','S','S'};
+static const size_t RECORD_FIXED = sizeof(char) + 2 * sizeof(uint32_t);
+
+// _______________ loadSnapshot ______________ //
+
+bool loadSnapshot(const string & path, uint64_t stamp,
+		  const function<void(char, const string &, const string &)> & apply) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd == -1) return false;
+  struct stat sb;
+  if(fstat(fd, &sb) == -1 || (size_t) sb.st_size < sizeof(SnapshotHeader)) {
+    close(fd);
+    return false;
+  } // if
+  void * addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED) return false;
+  const char * base = (const char *) addr;
+  const char * end = base + sb.st_size;
+  SnapshotHeader header;
+  memcpy(&header, base, sizeof(header));
+  bool valid = (memcmp(header.magic, SNAPSHOT_MAGIC, 4) == 0 && header.stamp == stamp);
+  // first pass validates, second pass applies
+  for(int pass = 0; pass < 2 && valid; pass++) {
+    const char * p = base + sizeof(header);
+    for(uint32_t i = 0; i < header.count; i++) {
+      if((size_t) (end - p) < RECORD_FIXED) { valid = false; break; } // if
+      char type = p[0];
+      uint32_t klen, vlen;
+      memcpy(&klen, p + 1, sizeof(klen));
+      memcpy(&vlen, p + 1 + sizeof(klen), sizeof(vlen));
+      p += RECORD_FIXED;
+      if((size_t) (end - p) < (size_t) klen + vlen) { valid = false; break; } // if
+      if(pass == 1) apply(type, string(p, klen), string(p + klen, vlen));
+      p += klen + vlen;
+    } // for
+  } // for
+  munmap(addr, sb.st_size);
+  return valid;
+} // loadSnapshot
+
+// _______________ saveSnapshot ______________ //
+
+int saveSnapshot(const string & path, uint64_t stamp, const vector<SnapshotRecord> & records) {
+  SnapshotHeader header;
+  memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+  header.count = records.size();
+  header.stamp = stamp;
+  string buf((const char *) &header, sizeof(header));
+  for(unsigned int i = 0; i < records.size(); i++) {
+    uint32_t klen = records[i].key.size();
+    uint32_t vlen = records[i].value.size();
+    buf += records[i].type;
+    buf.append((const char *) &klen, sizeof(klen));
+    buf.append((const char *) &vlen, sizeof(vlen));
+    buf += records[i].key;
+    buf += records[i].value;
+  } // for
+  // write to a temp file and rename it over the old snapshot so no shell maps a partial one
+  string tmp = path + ".tmp." + to_string(getpid());
+  int fd = open(tmp.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+  if(fd == -1) return -1;
+  size_t off = 0;
+  while(off < buf.size()) {
+    ssize_t n = write(fd, buf.data() + off, buf.size() - off);
+    if(n == -1) {
+      close(fd);
+      unlink(tmp.c_str());
+      return -1;
+    } // if
+    off += n;
+  } // while
+  close(fd);
+  if(rename(tmp.c_str(), path.c_str()) == -1) {
+    unlink(tmp.c_str());
+    return -1;
+  } // if
+  return 0;
+} // saveSnapshot
@@ -0,0 +1,38 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct SnapshotRecord {
+  char type; // 'E' for an environment variable
+  std::string key;
+  std::string value;
+}; // SnapshotRecord
+
+/**
+ * Maps the given snapshot file and, if its stamp matches, calls the given function for each
+ * of its records. Every record is bounds-checked before any is applied, so a truncated or
+ * corrupt snapshot is never partially applied.
+ *
+ * @param path the path of the snapshot file
+ * @param stamp the expected stamp (hash of the shell version and rc file contents)
+ * @param apply the function to call with (type, key, value) for each record
+ * @return true if the snapshot was valid and applied, false if not
+ */
+bool loadSnapshot(const std::string & path, uint64_t stamp,
+		  const std::function<void(char, const std::string &, const std::string &)> & apply);
+
+/**
+ * Writes the given records to the given snapshot file, replacing it atomically.
+ *
+ * @param path the path of the snapshot file
+ * @param stamp the stamp (hash of the shell version and rc file contents) to write
+ * @param records the records to write
+ * @return -1 upon any system call failure, 0 otherwise
+ */
+int saveSnapshot(const std::string & path, uint64_t stamp, const std::vector<SnapshotRecord> & records);
+
+#endif
@@ -0,0 +1,171 @@
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "Spool.h"
+
+using namespace std;
+
+static const int CURSOR_WIDTH = 20; // the cursor is always rewritten in place at this width
+
+/**
+ * Holds an flock() on a file for as long as it is in scope.
+ */
+class SpoolLock {
+ private:
+  int fd;
+ public:
+  bool locked;
+  SpoolLock(int fd) : fd(fd) {
+    while((this->locked = (flock(fd, LOCK_EX) == 0)) == false && errno == EINTR) {}
+  } // constructor
+  ~SpoolLock() {
+    if(locked) flock(fd, LOCK_UN);
+  } // destructor
+}; // SpoolLock
+
+/**
+ * Reads the offset stored in the cursor file; an empty cursor is offset 0.
+ */
+static off_t read_cursor(int fd) {
+  char buf[CURSOR_WIDTH + 2] = {0};
+  if(pread(fd, buf, CURSOR_WIDTH, 0) == -1) return -1;
+  return strtoll(buf, nullptr, 10);
+} // read_cursor
+
+/**
+ * Reads the record at the given offset of the queue into command.
+ *
+ * @return -1 upon any system call failure, 0 if the record is incomplete, otherwise the
+ *         offset just past the record
+ */
+static off_t read_record(int fd, off_t offset, string & command) {
+  static char buf[Spool::MAX_RECORD + 1];
+  ssize_t n = pread(fd, buf, sizeof(buf), offset);
+  if(n == -1) return -1;
+  char * end = (char *) memchr(buf, '\n', n);
+  if(end == nullptr) return 0;
+  command.assign(buf, end - buf);
+  return offset + (end - buf) + 1;
+} // read_record
+
+// ___________ constructors/destructors ____________ //
+
+Spool::Spool(string dir) : dir(dir) {} // constructor
+
+Spool::~Spool() {
+  if(queueFd != -1) close(queueFd);
+  if(cursorFd != -1) close(cursorFd);
+  if(logFd != -1) close(logFd);
+} // destructor
+
+//_____________ path() _____________ //
+
+const string & Spool::path() const {
+  return dir;
+} // path
+
+//_____________ open(bool) _____________ //
+
+int Spool::open(bool create) {
+  int flags = O_CLOEXEC | ((create) ? O_CREAT : 0);
+  if(create && mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) return -1;
+  this->queueFd = ::open((dir + "/queue").c_str(), O_RDWR | O_APPEND | flags, 0600);
+  if(queueFd == -1) return -1;
+  this->cursorFd = ::open((dir + "/cursor").c_str(), O_RDWR | flags, 0600);
+  if(cursorFd == -1) return -1;
+  this->logFd = ::open((dir + "/log").c_str(), O_RDWR | O_APPEND | flags, 0600);
+  if(logFd == -1) return -1;
+  return 0;
+} // open
+
+//_____________ log(const char*) _____________ //
+
+int Spool::log(const char * line) {
+  ssize_t len = strlen(line);
+  if(write(logFd, line, len) != len) return -1;
+  return fdatasync(logFd);
+} // log
+
+//_____________ enqueue(const string&) _____________ //
+
+int Spool::enqueue(const string & command) {
+  if(command.size() >= MAX_RECORD) {
+    errno = E2BIG;
+    return -1;
+  } // if
+  string record = command + '\n';
+  if(write(queueFd, record.data(), record.size()) != (ssize_t) record.size()) return -1;
+  return fdatasync(queueFd);
+} // enqueue
+
+//_____________ claim(SpoolRecord&) _____________ //
+
+int Spool::claim(SpoolRecord & rec) {
+  SpoolLock lock(cursorFd);
+  if(!lock.locked) return -1;
+  off_t offset = read_cursor(cursorFd);
+  if(offset == -1) return -1;
+  off_t next = read_record(queueFd, offset, rec.command);
+  if(next <= 0) return next;
+  rec.offset = offset;
+  // logs the claim before advancing the cursor: if this process dies in between, the
+  // record is still at the cursor, and recover() leaves claims at or past it alone
+  char line[64];
+  snprintf(line, sizeof(line), "C %lld %d\n", (long long) offset, (int) getpid());
+  if(log(line) == -1) return -1;
+  char cursor[CURSOR_WIDTH + 2];
+  snprintf(cursor, sizeof(cursor), "%0*lld\n", CURSOR_WIDTH, (long long) next);
+  if(pwrite(cursorFd, cursor, CURSOR_WIDTH + 1, 0) != CURSOR_WIDTH + 1) return -1;
+  if(fdatasync(cursorFd) == -1) return -1;
+  return 1;
+} // claim
+
+//_____________ finish(const SpoolRecord&, int) _____________ //
+
+int Spool::finish(const SpoolRecord & rec, int status) {
+  char line[64];
+  snprintf(line, sizeof(line), "D %lld %d\n", (long long) rec.offset, status);
+  return log(line);
+} // finish
+
+//_____________ recover() _____________ //
+
+int Spool::recover() {
+  SpoolLock lock(cursorFd);
+  if(!lock.locked) return -1;
+  off_t cursor = read_cursor(cursorFd);
+  if(cursor == -1) return -1;
+  struct stat sb;
+  if(fstat(logFd, &sb) == -1) return -1;
+  string contents(sb.st_size, '\0');
+  if(sb.st_size > 0 && pread(logFd, &contents[0], sb.st_size, 0) != sb.st_size) return -1;
+  map<long long, int> claimed; // offset -> pid of records claimed but not finished
+  for(size_t pos = 0, end; (end = contents.find('\n', pos)) != string::npos; pos = end + 1) {
+    char type;
+    long long offset;
+    int value;
+    if(sscanf(contents.c_str() + pos, "%c %lld %d", &type, &offset, &value) != 3) continue;
+    if(type == 'C') claimed[offset] = value;
+    else claimed.erase(offset); // finished or requeued
+  } // for
+  int requeued = 0;
+  for(auto & claim : claimed) {
+    if(claim.first >= cursor) continue; // the cursor will hand it out again
+    if(kill(claim.second, 0) == 0 || errno != ESRCH) continue; // its drainer is still running
+    SpoolRecord rec;
+    if(read_record(queueFd, claim.first, rec.command) <= 0 || enqueue(rec.command) == -1) return -1;
+    char line[64];
+    snprintf(line, sizeof(line), "R %lld %d\n", claim.first, claim.second);
+    if(log(line) == -1) return -1;
+    requeued++;
+  } // for
+  return requeued;
+} // recover
@@ -0,0 +1,101 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <string>
+#include <sys/types.h>
+
+struct SpoolRecord {
+  off_t offset = 0;
+  std::string command;
+}; // SpoolRecord
+
+/**
+ * A durable local job spool: a directory that commands are queued in by the enqueue
+ * builtin and claimed from by any number of "1730sh --drain" processes.
+ *
+ * The directory holds three files. "queue" gets one line per command, each appended with a
+ * single O_APPEND write, so submitters never need a lock and a record is never interleaved;
+ * a record is identified by its offset. "cursor" holds the offset of the next unclaimed
+ * record, and is only read and advanced under flock(), so each record is claimed exactly
+ * once. "log" gets a "C OFFSET PID" line when a record is claimed and a "D OFFSET STATUS"
+ * line when it finishes. Every write is synced before the next step depends on it: a
+ * record before enqueue() returns, and a claim before the cursor moves past it. A record claimed by a drainer that died is put back in the queue
+ * by the next drainer to call recover().
+ */
+class Spool {
+ private:
+  std::string dir;
+  int queueFd = -1;
+  int cursorFd = -1;
+  int logFd = -1;
+
+  /**
+   * Appends one line to the log with a single write, and syncs it.
+   *
+   * @param const char* the line, including its newline
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int log(const char *);
+ public:
+  /**
+   * Maximum length of a queued command, so a claim never has to read more than this.
+   */
+  static const size_t MAX_RECORD = 65536;
+  /**
+   * Constructor. The spool is not opened until open() is called.
+   *
+   * @param std::string the path of the spool directory
+   */
+  Spool(std::string);
+  /**
+   * Destructor. Closes the spool's files.
+   */
+  ~Spool();
+  /**
+   * Gets the path of the spool directory.
+   *
+   * @return the path given to the constructor
+   */
+  const std::string & path() const;
+  /**
+   * Opens the spool's files, creating the directory and files if asked to.
+   *
+   * @param create true if a missing spool should be created
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int open(bool create);
+  /**
+   * Appends a command to the queue. Costs a single write() and fdatasync(), and takes no
+   * lock.
+   *
+   * @param const std::string& the command, which must not contain a newline
+   * @return -1 upon any system call failure (or a command that is too long), 0 otherwise
+   */
+  int enqueue(const std::string &);
+  /**
+   * Claims the next unclaimed record. A record whose newline hasn't been written yet is
+   * left for a later claim.
+   *
+   * @param SpoolRecord& set to the record claimed
+   * @return -1 upon any system call failure, 0 if there is nothing to claim, 1 otherwise
+   */
+  int claim(SpoolRecord &);
+  /**
+   * Records the exit status of a claimed record.
+   *
+   * @param const SpoolRecord& the record that finished
+   * @param int its exit status
+   * @return -1 upon any system call failure, 0 otherwise
+   */
+  int finish(const SpoolRecord &, int);
+  /**
+   * Puts back in the queue every record that was claimed by a process that no longer
+   * exists and never finished.
+   *
+   * @return -1 upon any system call failure, otherwise the number of records requeued
+   */
+  int recover();
+
+}; // Spool
+
+#endif
@@ -0,0 +1,139 @@
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "TermWriter.h"
+
+using namespace std;
+
+/**
+ * Gets the milliseconds on CLOCK_MONOTONIC.
+ */
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+} // now_ms
+
+// ___________ constructors/destructors ____________ //
+
+TermWriter::TermWriter(int terminal) {
+  setp(buffer, buffer + sizeof(buffer));
+  this->fd = fcntl(terminal, F_DUPFD_CLOEXEC, 10);
+  if(fd == -1) return;
+  // signals are the main thread's to handle
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  this->worker = thread(&TermWriter::run, this);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+} // constructor
+
+TermWriter::~TermWriter() {
+  if(fd == -1) return;
+  sync();
+  {
+    lock_guard<std::mutex> lock(mutex);
+    this->stopping = true;
+  }
+  readable.notify_one();
+  worker.join();
+  close(fd);
+} // destructor
+
+//_____________ isOpen() _____________ //
+
+bool TermWriter::isOpen() const {
+  return fd != -1;
+} // isOpen
+
+//_____________ overflow(int) _____________ //
+
+int TermWriter::overflow(int c) {
+  sync();
+  if(c != EOF) {
+    *pptr() = (char) c;
+    pbump(1);
+  } // if
+  return (c == EOF) ? 0 : c;
+} // overflow
+
+//_____________ sync() _____________ //
+
+int TermWriter::sync() {
+  if(pptr() > pbase()) push(pbase(), pptr() - pbase());
+  setp(buffer, buffer + sizeof(buffer));
+  return 0;
+} // sync
+
+//_____________ push(const char*, size_t) _____________ //
+
+void TermWriter::push(const char * data, size_t len) {
+  unique_lock<std::mutex> lock(mutex);
+  while(queue.size() + inFlight + len > CAPACITY) {
+    if(inFlight > 0 && now_ms() - lastProgress >= STALL_MS) break; // the terminal isn't reading
+    writable.wait_for(lock, chrono::milliseconds(STALL_MS / 5));
+  } // while
+  if(queue.size() + inFlight + len > CAPACITY) {
+    this->dropped += len;
+    return;
+  } // if
+  if(dropped > 0) {
+    char note[96];
+    snprintf(note, sizeof(note), "\n1730sh: %zu bytes of output dropped while the terminal wasn't reading\n", dropped);
+    queue += note;
+    this->dropped = 0;
+  } // if
+  queue.append(data, len);
+  readable.notify_one();
+} // push
+
+//_____________ run() _____________ //
+
+void TermWriter::run() {
+  string out;
+  unique_lock<std::mutex> lock(mutex);
+  while(true) {
+    readable.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if(queue.empty()) break; // stopping, with nothing left to write
+    out.clear();
+    out.swap(queue);
+    this->inFlight = out.size();
+    this->lastProgress = now_ms();
+    lock.unlock();
+    for(size_t off = 0; off < out.size(); ) {
+      ssize_t n = write(fd, out.data() + off, out.size() - off);
+      if(n == -1 && errno == EAGAIN) { // a non-blocking terminal: waits for it instead
+	struct pollfd pfd = {fd, POLLOUT, 0};
+	poll(&pfd, 1, -1);
+	continue;
+      } else if(n == -1 && errno != EINTR) {
+	break; // e.g., the terminal hung up. what's left can't be written anywhere
+      } else if(n > 0) {
+	off += n;
+	lock_guard<std::mutex> progress(mutex);
+	this->inFlight -= n;
+	this->lastProgress = now_ms();
+	writable.notify_all();
+      } // if/else
+    } // for
+    lock.lock();
+    this->inFlight = 0;
+    writable.notify_all();
+  } // while
+} // run
+
+//_____________ drain(int64_t) _____________ //
+
+bool TermWriter::drain(int64_t timeoutMs) {
+  if(fd == -1) return true;
+  sync();
+  unique_lock<std::mutex> lock(mutex);
+  return writable.wait_for(lock, chrono::milliseconds(timeoutMs), [this]() { return queue.empty() && inFlight == 0; });
+} // drain
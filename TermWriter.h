@@ -0,0 +1,90 @@
+#ifndef TERMWRITER_H
+#define TERMWRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+/**
+ * A streambuf that hands what is written to it to a writer thread, which writes it to the
+ * terminal. Installed as cout's buffer by an interactive shell, so that a terminal that
+ * stops reading (a stalled SSH session, ^S) blocks only the writer thread, and the REPL
+ * keeps reaping and notifying about jobs.
+ *
+ * The queue is bounded by CAPACITY bytes. While it is full, writers wait for the terminal
+ * to catch up, as they would on a slow terminal, unless the terminal has made no progress
+ * for STALL_MS, in which case what doesn't fit is dropped. Once there is room again, a note
+ * of how many bytes were dropped is queued ahead of the next output.
+ *
+ * The writer thread writes to its own dup of the terminal fd, so output queued before a
+ * redirect is applied still goes to the terminal.
+ */
+class TermWriter : public std::streambuf {
+ private:
+  int fd;
+  char buffer[4096];
+  std::mutex mutex;
+  std::condition_variable readable; // output was queued, or stopping
+  std::condition_variable writable; // the terminal made progress
+  std::string queue;
+  size_t inFlight = 0;  // bytes taken off the queue but not yet written
+  size_t dropped = 0;
+  int64_t lastProgress = 0;
+  bool stopping = false;
+  std::thread worker;
+
+  /**
+   * Queues bytes for the writer thread, waiting for room or dropping them as above.
+   *
+   * @param data the bytes
+   * @param len the number of bytes
+   */
+  void push(const char * data, size_t len);
+  /**
+   * The writer thread's loop.
+   */
+  void run();
+ protected:
+  int overflow(int c);
+  int sync();
+ public:
+  /**
+   * Maximum number of bytes queued.
+   */
+  static const size_t CAPACITY = 256 * 1024;
+  /**
+   * Milliseconds without progress after which the terminal is considered stalled.
+   */
+  static const int64_t STALL_MS = 250;
+  /**
+   * Constructor. Dups the given fd and starts the writer thread, with every signal blocked.
+   *
+   * @param int the terminal's fd
+   */
+  TermWriter(int);
+  /**
+   * Destructor. Writes out what is queued, then stops the writer thread.
+   */
+  ~TermWriter();
+  /**
+   * Determines if the terminal fd could be dupped.
+   *
+   * @return true if the writer can be used, false if not
+   */
+  bool isOpen() const;
+  /**
+   * Waits until everything written so far has been written to the terminal, or the given
+   * time has passed. Called before forking, so the output of a job comes after the prompt
+   * and notifications printed before it.
+   *
+   * @param timeoutMs the most milliseconds to wait
+   * @return true if everything was written, false if the wait timed out
+   */
+  bool drain(int64_t timeoutMs);
+
+}; // TermWriter
+
+#endif
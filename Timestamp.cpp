@@ -0,0 +1,113 @@
+
+#include <cstdio>
+#include <cstring>
+#include "Timestamp.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+#if defined(__x86_64__)
+/**
+ * Finds newlines 32 bytes at a time. Returns the number of bytes scanned; the rest (fewer
+ * than 32) are left to the caller.
+ */
+__attribute__((target("avx2"))) static size_t find_newlines_avx2(const char * data, size_t len, vector<size_t> & found) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+    uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    for(; mask != 0; mask &= mask - 1) found.push_back(i + __builtin_ctz(mask));
+  } // for
+  return i;
+} // find_newlines_avx2
+
+/**
+ * Finds newlines 16 bytes at a time with SSE2, which every x86-64 CPU has.
+ */
+static size_t find_newlines_sse2(const char * data, size_t len, vector<size_t> & found) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+    uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    for(; mask != 0; mask &= mask - 1) found.push_back(i + __builtin_ctz(mask));
+  } // for
+  return i;
+} // find_newlines_sse2
+
+static const bool HAS_AVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+//_____________ findNewlines(const char*, size_t, vector<size_t>&) _____________ //
+
+void Timestamp::findNewlines(const char * data, size_t len, vector<size_t> & found) {
+  found.clear();
+  size_t i = 0;
+#if defined(__x86_64__)
+  i = (HAS_AVX2) ? find_newlines_avx2(data, len, found) : find_newlines_sse2(data, len, found);
+#endif
+  for(const char * p; i < len && (p = (const char *) memchr(data + i, '\n', len - i)) != nullptr; i = p - data + 1) {
+    found.push_back(p - data);
+  } // for
+} // findNewlines
+
+// ___________ constructors/destructors ____________ //
+
+Timestamp::Timestamp(Clock clock) : clock(clock) {
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  last = start;
+} // constructor
+
+//_____________ stamp(char*) _____________ //
+
+size_t Timestamp::stamp(char * buf) {
+  struct timespec now;
+  if(clock == WALL) {
+    clock_gettime(CLOCK_REALTIME, &now);
+    if(now.tv_sec != cachedSecond) { // localtime_r() and strftime() once a second at most
+      struct tm tm;
+      localtime_r(&now.tv_sec, &tm);
+      strftime(cachedDate, sizeof(cachedDate), "%Y-%m-%d %H:%M:%S", &tm);
+      cachedSecond = now.tv_sec;
+    } // if
+    return snprintf(buf, 48, "%s.%06ld ", cachedDate, now.tv_nsec / 1000);
+  } // if
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  const struct timespec & since = (clock == MONO) ? start : last;
+  long long usec = (now.tv_sec - since.tv_sec) * 1000000LL + (now.tv_nsec - since.tv_nsec) / 1000;
+  last = now;
+  return snprintf(buf, 48, (clock == MONO) ? "[%5lld.%06lld] " : "[+%4lld.%06lld] ", usec / 1000000, usec % 1000000);
+} // stamp
+
+//_____________ filter(const char*, size_t, string&) _____________ //
+
+bool Timestamp::filter(const char * data, size_t len, string & out) {
+  if(len == 0) return false;
+  char buf[48];
+  size_t stampLen = stamp(buf);
+  findNewlines(data, len, newlines);
+  out.reserve(len + (newlines.size() + 1) * stampLen);
+  size_t from = 0;
+  if(atLineStart) out.append(buf, stampLen);
+  for(size_t nl : newlines) {
+    out.append(data + from, nl + 1 - from);
+    from = nl + 1;
+    if(from < len) out.append(buf, stampLen); // the next line starts in this chunk too
+  } // for
+  out.append(data + from, len - from);
+  this->atLineStart = (data[len - 1] == '\n');
+  return true;
+} // filter
+
+//_____________ create(const string&) _____________ //
+
+Timestamp * Timestamp::create(const string & name) {
+  if(name == "" || name == "wall") return new Timestamp(WALL);
+  if(name == "mono") return new Timestamp(MONO);
+  if(name == "delta") return new Timestamp(DELTA);
+  return nullptr;
+} // create
@@ -0,0 +1,68 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "Relay.h"
+
+/**
+ * Stamps each line flowing through a relay with the time it was read. Used by timestamp
+ * redirects ('>@CLOCK FILE'), so a job's log lines are stamped by the shell itself instead
+ * of by a 'ts' process at the end of a pipeline.
+ *
+ * Every line that starts in a chunk read by the relay gets the same stamp, taken when
+ * filter() is called, i.e., as soon as the chunk was read. The stamped chunk is handed back
+ * to the relay whole, so it is written with one write() however many lines it holds.
+ */
+class Timestamp : public RelayFilter {
+ public:
+  enum Clock {
+    WALL,  // local date and time, e.g., "2026-10-18 20:08:01.123456 "
+    MONO,  // seconds since the relay started, e.g., "[   12.345678] "
+    DELTA, // seconds since the previous stamp, e.g., "[+   0.001234] "
+  }; // Clock
+ private:
+  Clock clock;
+  bool atLineStart = true;
+  struct timespec start;
+  struct timespec last;
+  time_t cachedSecond = -1;
+  char cachedDate[32];
+  std::vector<size_t> newlines;
+
+  /**
+   * Formats the stamp for the current time.
+   *
+   * @param buf the buffer to format it in, at least 48 bytes
+   * @return the length of the stamp
+   */
+  size_t stamp(char * buf);
+ public:
+  /**
+   * Constructor. MONO stamps count from now.
+   *
+   * @param Clock the clock to stamp lines with
+   */
+  Timestamp(Clock);
+  bool filter(const char * data, size_t len, std::string & out);
+  /**
+   * Finds every newline in the given bytes, 32 at a time with AVX2 (or 16 at a time with
+   * SSE2) on x86-64, and with memchr() elsewhere.
+   *
+   * @param data the bytes
+   * @param len the number of bytes
+   * @param found cleared, then set to the offsets of the newlines, in order
+   */
+  static void findNewlines(const char * data, size_t len, std::vector<size_t> & found);
+  /**
+   * Creates a filter by clock name: "" or "wall", "mono", or "delta".
+   *
+   * @param name the name of the clock
+   * @return the dynamically allocated filter, which must be deleted, or nullptr if the name
+   *         is unknown
+   */
+  static Timestamp * create(const std::string & name);
+}; // Timestamp
+
+#endif
@@ -0,0 +1,143 @@
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "Watchdog.h"
+
+using namespace std;
+
+static const size_t MAX_PHASES = 240; // characters of phases kept per stall
+
+/**
+ * Gets the milliseconds on CLOCK_MONOTONIC.
+ */
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+} // now_ms
+
+// ___________ constructors/destructors ____________ //
+
+Watchdog::Watchdog(unsigned int threshold) {
+  this->phase = "start";
+  this->detail = nullptr;
+  this->isIdle = true;
+  this->busySince = now_ms();
+  this->idleSince = busySince.load();
+  this->jobs = 0;
+  this->thresholdMs = threshold;
+  this->tid = syscall(SYS_gettid);
+  // signals are the main thread's to handle
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  this->worker = thread([this]() {
+      unique_lock<std::mutex> lock(this->mutex);
+      while(!this->stopping) {
+	unsigned int t = this->thresholdMs;
+	this->wakeup.wait_for(lock, chrono::milliseconds((t == 0) ? 1000 : max(t / 4, 10u)));
+	if(!this->stopping) check();
+      } // while
+    });
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+} // constructor
+
+Watchdog::~Watchdog() {
+  {
+    lock_guard<std::mutex> lock(mutex);
+    this->stopping = true;
+  }
+  wakeup.notify_one();
+  worker.join();
+} // destructor
+
+//_____________ setThreshold(unsigned int) _____________ //
+
+void Watchdog::setThreshold(unsigned int threshold) {
+  this->thresholdMs = threshold;
+} // setThreshold
+
+//_____________ busy(const char*, size_t, const char*) _____________ //
+
+void Watchdog::busy(const char * phase, size_t jobs, const char * detail) {
+  if(isIdle.load(memory_order_relaxed)) {
+    this->busySince = now_ms();
+    this->isIdle = false;
+  } // if
+  this->phase = phase;
+  this->detail = detail;
+  this->jobs = jobs;
+} // busy
+
+//_____________ idle(const char*) _____________ //
+
+void Watchdog::idle(const char * phase) {
+  this->idleSince = now_ms();
+  this->phase = phase;
+  this->detail = nullptr;
+  this->isIdle = true;
+} // idle
+
+//_____________ check() _____________ //
+
+void Watchdog::check() {
+  int64_t now = now_ms();
+  bool idleNow = isIdle;
+  int64_t since = busySince;
+  unsigned int threshold = thresholdMs;
+  if(currentSince != -1 && (idleNow || since != currentSince)) { // the ongoing stall ended
+    Stall & stall = ring.back();
+    int64_t end = idleSince;
+    if(end >= currentSince) stall.seconds = (end - currentSince) / 1000.0;
+    stall.ongoing = false;
+    this->currentSince = -1;
+  } // if
+  if(idleNow || threshold == 0 || now - since < threshold) return;
+  if(currentSince != since) { // a new stall: notes what the main thread is blocked in
+    Stall stall;
+    stall.when = time(nullptr) - (now - since) / 1000;
+    string task = "/proc/self/task/" + to_string(tid);
+    string stat;
+    getline(ifstream(task + "/stat"), stat);
+    size_t paren = stat.rfind(')');
+    if(paren != string::npos && paren + 2 < stat.size()) stall.state = stat[paren + 2];
+    getline(ifstream(task + "/wchan"), stall.wchan);
+    if(stall.wchan == "0") stall.wchan = "";
+    ring.push_back(stall);
+    if(ring.size() > RING) ring.pop_front();
+    this->currentSince = since;
+    this->lastPhase = "";
+  } // if
+  Stall & stall = ring.back();
+  stall.seconds = (now - since) / 1000.0;
+  const char * d = detail;
+  string current = string(phase.load()) + ((d != nullptr) ? string("(") + d + ")" : "");
+  if(current != lastPhase && stall.phases.size() < MAX_PHASES) {
+    stall.phases += ((stall.phases.empty()) ? "" : " > ") + current;
+    this->lastPhase = current;
+  } // if
+  stall.jobs = max(stall.jobs, jobs.load());
+  int queued;
+  if(ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) == 0) stall.outputQueued = max(stall.outputQueued, queued);
+} // check
+
+//_____________ stalls() _____________ //
+
+vector<Stall> Watchdog::stalls() {
+  lock_guard<std::mutex> lock(mutex);
+  return vector<Stall>(ring.begin(), ring.end());
+} // stalls
+
+//_____________ clear() _____________ //
+
+void Watchdog::clear() {
+  lock_guard<std::mutex> lock(mutex);
+  ring.clear();
+  this->currentSince = -1;
+} // clear
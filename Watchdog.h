@@ -0,0 +1,111 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * A time the REPL was busy for longer than the watchdog's threshold, and what it was
+ * doing meanwhile.
+ */
+struct Stall {
+  time_t when = 0;         // when it started
+  double seconds = 0;      // how long the REPL was busy, so far if ongoing
+  std::string phases;      // the phases it went through while stalled, e.g. "prompt > run_line(cd)"
+  size_t jobs = 0;         // the size of current_jobs
+  int outputQueued = 0;    // bytes written to the terminal but not yet sent by it (TIOCOUTQ)
+  char state = '?';        // the main thread's scheduler state (R, S, D, ...) when noticed
+  std::string wchan;       // the kernel function it was blocked in, if any
+  bool ongoing = true;
+}; // Stall
+
+/**
+ * Watches the REPL for stalls: times when the shell is neither waiting for input nor for a
+ * foreground job, yet hasn't returned to the prompt within a threshold. The main thread
+ * marks each phase of its loop with busy() or idle(), which cost a clock read and a few
+ * atomic stores. A thread checks those marks THRESHOLD/4 times a second, and records each
+ * stall it notices, along with the state of the main thread and the terminal, in a ring of
+ * the last RING stalls.
+ */
+class Watchdog {
+ private:
+  std::atomic<const char *> phase;
+  std::atomic<const char *> detail;
+  std::atomic<bool> isIdle;
+  std::atomic<int64_t> busySince; // ms on CLOCK_MONOTONIC since the REPL last stopped waiting
+  std::atomic<int64_t> idleSince;
+  std::atomic<size_t> jobs;
+  std::atomic<unsigned int> thresholdMs;
+  pid_t tid;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping = false;
+  std::deque<Stall> ring;
+  int64_t currentSince = -1; // busySince of the ongoing stall, or -1
+  std::string lastPhase;
+  std::thread worker;
+
+  /**
+   * Checks on the main thread, recording a stall if it is in one. Called with mutex held.
+   */
+  void check();
+ public:
+  /**
+   * Number of stalls kept.
+   */
+  static const size_t RING = 32;
+  /**
+   * Constructor. Must be called on the main thread, which is the one watched. Starts the
+   * watchdog thread, with every signal blocked.
+   *
+   * @param unsigned int the threshold in milliseconds; 0 turns the watchdog off
+   */
+  Watchdog(unsigned int);
+  /**
+   * Destructor. Stops the watchdog thread.
+   */
+  ~Watchdog();
+  /**
+   * Changes the threshold.
+   *
+   * @param unsigned int the threshold in milliseconds; 0 turns the watchdog off
+   */
+  void setThreshold(unsigned int);
+  /**
+   * Marks the start of a phase in which the REPL is busy.
+   *
+   * @param phase the name of the phase, which must outlive the watchdog (e.g., a literal)
+   * @param jobs the size of current_jobs
+   * @param detail more about the phase (e.g., the builtin running), or nullptr; must outlive
+   *        the watchdog too
+   */
+  void busy(const char * phase, size_t jobs, const char * detail = nullptr);
+  /**
+   * Marks the start of a phase in which the REPL is waiting (for input, or for a foreground
+   * job), which never counts as a stall.
+   *
+   * @param phase the name of the phase, which must outlive the watchdog
+   */
+  void idle(const char * phase);
+  /**
+   * Gets the stalls recorded, oldest first.
+   *
+   * @return a copy of the ring
+   */
+  std::vector<Stall> stalls();
+  /**
+   * Forgets the stalls recorded.
+   */
+  void clear();
+
+}; // Watchdog
+
+#endif
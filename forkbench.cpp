@@ -0,0 +1,66 @@
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <sys/wait.h>
+#include "Arena.h"
+
+using namespace std;
+
+// Fork latency benchmark. Grows a cache of small blocks (like map nodes and strings) to
+// each size, once on the ordinary heap and once in an Arena, then times fork() + waitpid()
+// of a child that immediately _exit()s. Heap-backed caches make fork() slower as they grow,
+// since their page tables are copied; arena-backed ones are skipped (MADV_DONTFORK).
+//
+// Usage: forkbench [MAX_MB]
+
+static const size_t BLOCK = 256;
+static const int FORKS = 50;
+
+/**
+ * Gets the wall clock seconds from a monotonic clock.
+ */
+double wall_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+} // wall_seconds
+
+/**
+ * Gets the average microseconds for a fork() whose child immediately exits.
+ */
+double fork_micros() {
+  double start = wall_seconds();
+  for(int i = 0; i < FORKS; i++) {
+    pid_t pid = fork();
+    if(pid == -1) { perror("fork"); exit(EXIT_FAILURE); } // if
+    if(pid == 0) _exit(EXIT_SUCCESS);
+    waitpid(pid, nullptr, 0);
+  } // for
+  return (wall_seconds() - start) / FORKS * 1e6;
+} // fork_micros
+
+int main(int argc, char * argv[]) {
+  size_t maxMB = (argc > 1) ? atol(argv[1]) : 512;
+  cout << setw(10) << "cache MB" << setw(14) << "heap us/fork" << setw(15) << "arena us/fork" << endl;
+  for(size_t mb = 0; mb <= maxMB; mb = (mb == 0) ? 32 : mb * 2) {
+    size_t blocks = mb * (1 << 20) / BLOCK;
+    vector<char *> heap;
+    heap.reserve(blocks);
+    for(size_t i = 0; i < blocks; i++) {
+      heap.push_back((char *) malloc(BLOCK));
+      memset(heap.back(), 1, BLOCK);
+    } // for
+    double heapUs = fork_micros();
+    for(size_t i = 0; i < blocks; i++) free(heap[i]);
+    vector<char *>().swap(heap);
+    Arena arena; // unmapped at the end of the iteration
+    for(size_t i = 0; i < blocks; i++) memset(arena.allocate(BLOCK), 1, BLOCK);
+    double arenaUs = fork_micros();
+    cout << setw(10) << mb << fixed << setprecision(1) << setw(14) << heapUs << setw(15) << arenaUs << endl;
+  } // for
+  return EXIT_SUCCESS;
+} // main
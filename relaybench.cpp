@@ -0,0 +1,114 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "Relay.h"
+
+using namespace std;
+
+// Relay throughput benchmark. For each engine and mode, a producer process writes GB gigabytes
+// into a pipe, the engine relays them into a second pipe, and a consumer process drains it.
+// Reports the relayed GB/s and the relay's own CPU seconds (user + sys) per GB.
+//
+// Usage: relaybench [GB]
+
+/**
+ * A filter that looks at every byte without changing any, like a checksum would.
+ */
+class SumFilter : public RelayFilter {
+ public:
+  uint64_t sum = 0;
+  bool filter(const char * data, size_t len, string & out) {
+    for(size_t i = 0; i < len; i += 64) sum += (unsigned char) data[i];
+    return false;
+  } // filter
+}; // SumFilter
+
+/**
+ * Gets the CPU seconds (user + sys) used so far by this process, including its threads.
+ */
+double cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+} // cpu_seconds
+
+/**
+ * Gets the wall clock seconds from a monotonic clock.
+ */
+double wall_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+} // wall_seconds
+
+/**
+ * Runs one producer -> relay -> consumer pass and prints its results.
+ */
+void run(RelayEngine * engine, bool filtered, uint64_t bytes) {
+  int in[2], out[2];
+  if(pipe(in) == -1 || pipe(out) == -1) { perror("pipe"); exit(EXIT_FAILURE); } // if
+  fcntl(in[1], F_SETPIPE_SZ, 1 << 20);
+  fcntl(out[1], F_SETPIPE_SZ, 1 << 20);
+  pid_t producer = fork();
+  if(producer == 0) {
+    close(in[0]); close(out[0]); close(out[1]);
+    static char buf[1 << 20];
+    memset(buf, 'x', sizeof(buf));
+    for(uint64_t left = bytes; left > 0; ) {
+      ssize_t n = write(in[1], buf, (left < sizeof(buf)) ? left : sizeof(buf));
+      if(n <= 0) _exit(EXIT_FAILURE);
+      left -= n;
+    } // for
+    _exit(EXIT_SUCCESS);
+  } // if
+  pid_t consumer = fork();
+  if(consumer == 0) {
+    close(in[0]); close(in[1]); close(out[1]);
+    static char buf[1 << 20];
+    while(read(out[0], buf, sizeof(buf)) > 0) {}
+    _exit(EXIT_SUCCESS);
+  } // if
+  close(in[1]);
+  close(out[0]);
+  SumFilter filter;
+  RelayStats stats;
+  double wall = wall_seconds();
+  double cpu = cpu_seconds();
+  int res = engine->relay(in[0], {out[1]}, (filtered) ? &filter : nullptr, stats);
+  cpu = cpu_seconds() - cpu;
+  wall = wall_seconds() - wall;
+  close(in[0]);
+  close(out[1]);
+  waitpid(producer, nullptr, 0);
+  waitpid(consumer, nullptr, 0);
+  double gb = stats.bytesOut / 1e9;
+  cout << std::left << setw(10) << engine->name() << setw(10) << ((filtered) ? "buffered" : "splice")
+       << std::right << fixed << setprecision(2)
+       << setw(8) << gb / wall << " GB/s"
+       << setw(8) << cpu / gb << " CPU s/GB"
+       << setw(10) << stats.syscalls << " syscalls"
+       << ((res == -1 || stats.bytesOut != bytes) ? "  (FAILED)" : "") << endl;
+} // run
+
+int main(int argc, char * argv[]) {
+  double gb = (argc > 1) ? atof(argv[1]) : 1.0;
+  uint64_t bytes = (uint64_t) (gb * 1e9);
+  signal(SIGPIPE, SIG_IGN);
+  setenv("RELAY_ENGINE", "io_uring", 1); // not the default, so it has to be asked for
+  RelayEngine * engines[2] = {RelayEngine::create(), RelayEngine::createFallback()};
+  for(int e = 0; e < 2; e++) {
+    if(e == 1 && string(engines[0]->name()) == engines[1]->name()) break; // io_uring unavailable
+    run(engines[e], false, bytes);
+    run(engines[e], true, bytes);
+  } // for
+  delete engines[0];
+  delete engines[1];
+  return EXIT_SUCCESS;
+} // main